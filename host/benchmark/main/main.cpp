@@ -0,0 +1,124 @@
+// system includes
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// local includes
+#include "espasyncota.h"
+#include "loopbackotatransport.h"
+#include "memoryotasink.h"
+#include "tickchrono.h"
+
+using namespace std::chrono_literals;
+
+// Pushes images through enqueue() -> otaTask() -> Succeeded over a
+// LoopbackOtaTransport into a MemoryOtaSink and prints one JSON object per job
+// on stdout. Configured through the environment:
+//   OTA_BENCH_SIZES      image sizes in MiB, comma separated (1,2,4,8)
+//   OTA_BENCH_BANDWIDTH  link bandwidth in bytes/s, 0 for unlimited (0)
+//   OTA_BENCH_RTT_MS     round trip time per connection (0)
+//   OTA_BENCH_SEGMENT    bytes per read (1460)
+//   OTA_BENCH_RUNS       jobs per image size (3)
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA_BENCH";
+
+std::size_t envValue(const char *name, std::size_t fallback)
+{
+    const char * const str = std::getenv(name);
+    if (!str)
+        return fallback;
+
+    std::size_t value{};
+    if (const std::string_view view{str}; std::from_chars(view.data(), view.data() + view.size(), value).ec != std::errc{})
+    {
+        ESP_LOGW(TAG, "ignoring invalid %s=%s", name, str);
+        return fallback;
+    }
+    return value;
+}
+
+std::vector<std::size_t> envSizes(const char *name)
+{
+    std::string_view str = std::getenv(name) ? std::getenv(name) : "1,2,4,8";
+
+    std::vector<std::size_t> sizes;
+    while (!str.empty())
+    {
+        const auto comma = str.find(',');
+        const auto item = str.substr(0, comma);
+        if (std::size_t mib{}; std::from_chars(item.data(), item.data() + item.size(), mib).ec == std::errc{} && mib)
+            sizes.push_back(mib * 1024 * 1024);
+        else
+            ESP_LOGW(TAG, "ignoring invalid image size %.*s", int(item.size()), item.data());
+        str = comma == std::string_view::npos ? std::string_view{} : str.substr(comma + 1);
+    }
+    return sizes;
+}
+
+bool runJob(EspAsyncOta &ota, std::size_t imageSize, const OtaLoopbackLink &link)
+{
+    std::vector<uint8_t> image(imageSize);
+    std::generate(std::begin(image), std::end(image), [seed = 1u]() mutable { seed = seed * 1103515245 + 12345; return uint8_t(seed >> 16); });
+    std::vector<uint8_t> storage(imageSize);
+
+    LoopbackOtaTransport transport{image, link};
+    MemoryOtaSink sink{storage};
+
+    const auto id = ota.enqueue(transport, sink);
+    if (!id)
+    {
+        ESP_LOGE(TAG, "enqueue() failed: %s", id.error().c_str());
+        return false;
+    }
+
+    std::optional<OtaJobResult> result;
+    while (!(result = ota.jobResult(*id)))
+        vTaskDelay(std::chrono::ceil<espcpputils::ticks>(10ms).count());
+
+    const bool succeeded = result->status == OtaCloudUpdateStatus::Succeeded && std::ranges::equal(sink.image(), image);
+
+    std::printf(R"({"imageSize":%zu,"bandwidth":%zu,"rttMs":%lld,"segmentSize":%zu,"valid":%s,"stats":%s})" "\n",
+                imageSize, link.bytesPerSecond, (long long)link.rtt.count(), link.segmentSize,
+                succeeded ? "true" : "false", ota.jobStats().toJson().c_str());
+    std::fflush(stdout);
+
+    return succeeded;
+}
+} // namespace
+
+extern "C" void app_main()
+{
+    // stdout carries the results
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    const OtaLoopbackLink link {
+        .rtt = std::chrono::milliseconds{envValue("OTA_BENCH_RTT_MS", 0)},
+        .bytesPerSecond = envValue("OTA_BENCH_BANDWIDTH", 0),
+        .segmentSize = std::max<std::size_t>(envValue("OTA_BENCH_SEGMENT", 1460), 1),
+        .dropAt = std::nullopt
+    };
+    const auto runs = envValue("OTA_BENCH_RUNS", 3);
+
+    EspAsyncOta ota;
+    if (const auto result = ota.startTask(); !result)
+    {
+        ESP_LOGE(TAG, "startTask() failed: %s", result.error().c_str());
+        std::exit(EXIT_FAILURE);
+    }
+
+    bool succeeded{true};
+    for (const auto imageSize : envSizes("OTA_BENCH_SIZES"))
+        for (std::size_t run = 0; run < runs; run++)
+            succeeded &= runJob(ota, imageSize, link);
+
+    std::exit(succeeded ? EXIT_SUCCESS : EXIT_FAILURE);
+}
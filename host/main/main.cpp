@@ -0,0 +1,73 @@
+// system includes
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// local includes
+#include "espasyncota.h"
+#include "loopbackotatransport.h"
+#include "memoryotasink.h"
+#include "tickchrono.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA_HOST";
+
+constexpr std::size_t IMAGE_SIZE = 1024 * 1024;
+
+// runs one job to its end, dropping the connection halfway to go through a resume
+bool runJob(EspAsyncOta &ota)
+{
+    std::vector<uint8_t> image(IMAGE_SIZE);
+    std::generate(std::begin(image), std::end(image), [seed = 1u]() mutable { seed = seed * 1103515245 + 12345; return uint8_t(seed >> 16); });
+    std::vector<uint8_t> storage(IMAGE_SIZE);
+
+    LoopbackOtaTransport transport{image, { .rtt = 20ms, .bytesPerSecond = 0, .segmentSize = 1460, .dropAt = IMAGE_SIZE / 2 }};
+    MemoryOtaSink sink{storage};
+
+    const auto id = ota.enqueue(transport, sink);
+    if (!id)
+    {
+        ESP_LOGE(TAG, "enqueue() failed: %s", id.error().c_str());
+        return false;
+    }
+
+    std::optional<OtaJobResult> result;
+    while (!(result = ota.jobResult(*id)))
+        vTaskDelay(std::chrono::ceil<espcpputils::ticks>(10ms).count());
+
+    if (result->status != OtaCloudUpdateStatus::Succeeded)
+    {
+        ESP_LOGE(TAG, "job ended with %s: %s", toString(result->status).c_str(), result->error.toString().c_str());
+        return false;
+    }
+
+    if (!std::ranges::equal(sink.image(), image))
+    {
+        ESP_LOGE(TAG, "written image differs from the served one");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "%zd bytes over %zd connections, stats %s", sink.image().size(), transport.opens(), ota.jobStats().toJson().c_str());
+    return true;
+}
+} // namespace
+
+extern "C" void app_main()
+{
+    EspAsyncOta ota;
+    if (const auto result = ota.startTask(); !result)
+    {
+        ESP_LOGE(TAG, "startTask() failed: %s", result.error().c_str());
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::exit(runJob(ota) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
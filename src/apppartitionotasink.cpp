@@ -0,0 +1,56 @@
+#include "apppartitionotasink.h"
+
+#include "sdkconfig.h"
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_app_format.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+} // namespace
+
+AppPartitionOtaSink::AppPartitionOtaSink(const esp_partition_t *partition) :
+    PartitionOtaSink{partition ? partition : esp_ota_get_next_update_partition(NULL)}
+{
+}
+
+esp_err_t AppPartitionOtaSink::begin(std::optional<std::size_t> imageSize, std::size_t offset)
+{
+#ifdef CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    // same guard as esp_ota_begin(), the partition written next may hold the only image to roll back to
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        ESP_LOGE(TAG, "running app has not been confirmed yet (ESP_OTA_IMG_PENDING_VERIFY)");
+        return ESP_ERR_OTA_ROLLBACK_INVALID_STATE;
+    }
+#endif
+
+    return PartitionOtaSink::begin(imageSize, offset);
+}
+
+esp_err_t AppPartitionOtaSink::write(std::span<const uint8_t> data)
+{
+    if (!data.empty() && position() == 0 && data[0] != ESP_IMAGE_HEADER_MAGIC)
+    {
+        ESP_LOGE(TAG, "invalid image magic 0x%02x", data[0]);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    return PartitionOtaSink::write(data);
+}
+
+esp_err_t AppPartitionOtaSink::finish()
+{
+    if (const auto result = PartitionOtaSink::finish(); result != ESP_OK)
+        return result;
+
+    if (const auto result = esp_ota_set_boot_partition(partition()); result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition() failed with %s", esp_err_to_name(result));
+        return result;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// esp-idf includes
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+// local includes
+#include "partitionotasink.h"
+
+// Writes the image straight into an app partition, erasing sector by sector
+// ahead of the write position. The image is verified once by
+// esp_ota_set_boot_partition() in finish().
+class AppPartitionOtaSink : public PartitionOtaSink
+{
+public:
+    explicit AppPartitionOtaSink(const esp_partition_t *partition = nullptr);
+
+    esp_err_t begin(std::optional<std::size_t> imageSize, std::size_t offset) override;
+    esp_err_t write(std::span<const uint8_t> data) override;
+    esp_err_t finish() override;
+
+    bool bootable() const override { return true; }
+};
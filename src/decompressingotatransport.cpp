@@ -0,0 +1,328 @@
+#include "decompressingotatransport.h"
+
+// system includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <strings.h>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_http_client.h>
+#include <rom/miniz.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr std::size_t INPUT_SIZE = DecompressingOtaTransport::inputSize;
+constexpr int MAX_DETECT_RETRIES = 3;
+
+constexpr uint8_t GZIP_FLAG_HCRC = 0x02;
+constexpr uint8_t GZIP_FLAG_EXTRA = 0x04;
+constexpr uint8_t GZIP_FLAG_NAME = 0x08;
+constexpr uint8_t GZIP_FLAG_COMMENT = 0x10;
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+} // namespace
+
+struct DecompressingOtaTransport::State
+{
+    tinfl_decompressor decompressor;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+};
+
+DecompressingOtaTransport::DecompressingOtaTransport(OtaTransport &inner, OtaCompression compression, std::span<uint8_t> input) :
+    m_inner{inner},
+    m_compression{compression},
+    m_staticInput{input}
+{
+    assert(m_staticInput.empty() || m_staticInput.size() >= INPUT_SIZE);
+}
+
+DecompressingOtaTransport::~DecompressingOtaTransport() = default;
+
+esp_err_t DecompressingOtaTransport::open(std::size_t offset)
+{
+    close();
+
+    if (offset)
+    {
+        // resuming is only possible once the stream is known to be uncompressed
+        if (m_stage != Stage::Passthrough)
+        {
+            ESP_LOGE(TAG, "compressed images cannot be opened at an offset");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        return m_inner.open(offset);
+    }
+
+    m_detected = OtaCompression::None;
+
+    if (m_compression == OtaCompression::None)
+    {
+        m_stage = Stage::Passthrough;
+        return m_inner.open(0);
+    }
+
+    if (const auto result = m_inner.open(0); result != ESP_OK)
+        return result;
+
+    if (!m_staticInput.empty())
+        m_input = m_staticInput.data();
+    else
+    {
+        m_ownedInput.reset(new (std::nothrow) uint8_t[INPUT_SIZE]);
+        if (!m_ownedInput)
+            return ESP_ERR_NO_MEM;
+        m_input = m_ownedInput.get();
+    }
+
+    const auto encoding = m_inner.contentEncoding();
+    if (m_compression == OtaCompression::Gzip || equalsIgnoreCase(encoding, "gzip") || equalsIgnoreCase(encoding, "x-gzip"))
+    {
+        m_detected = OtaCompression::Gzip;
+        m_stage = Stage::GzipHeader;
+    }
+    else if (m_compression == OtaCompression::Zlib || equalsIgnoreCase(encoding, "deflate"))
+    {
+        m_detected = OtaCompression::Zlib;
+        if (const auto result = startInflate(true); result != ESP_OK)
+            return result;
+    }
+    else
+    {
+        m_stage = Stage::Detect;
+        for (int retries = 0; m_stage == Stage::Detect; retries++)
+            if (const auto result = detect(); !result && (result.error() != ESP_ERR_HTTP_EAGAIN || retries >= MAX_DETECT_RETRIES))
+                return result.error();
+    }
+
+    ESP_LOGI(TAG, "image compression: %s", toString(m_detected).c_str());
+
+    return ESP_OK;
+}
+
+std::optional<std::size_t> DecompressingOtaTransport::contentLength() const
+{
+    if (m_stage == Stage::Passthrough)
+        return m_inner.contentLength();
+    return std::nullopt;
+}
+
+std::expected<std::size_t, esp_err_t> DecompressingOtaTransport::read(std::span<uint8_t> buffer)
+{
+    while (true)
+    {
+        if (m_pendingSize)
+            return copyPending(buffer);
+
+        switch (m_stage)
+        {
+        case Stage::Detect:
+            if (const auto result = detect(); !result)
+                return std::unexpected(result.error());
+            continue;
+
+        case Stage::GzipHeader:
+            if (const auto result = parseGzipHeader(); !result)
+                return std::unexpected(result.error());
+            if (const auto result = startInflate(false); result != ESP_OK)
+                return std::unexpected(result);
+            continue;
+
+        case Stage::Passthrough:
+            if (m_inputSize)
+            {
+                const auto count = std::min(m_inputSize, buffer.size());
+                std::memcpy(buffer.data(), &m_input[m_inputOffset], count);
+                m_inputOffset += count;
+                m_inputSize -= count;
+                return count;
+            }
+            return m_inner.read(buffer);
+
+        case Stage::Inflate:
+        {
+            if (!m_inputSize && !m_inputEof)
+                if (const auto result = fill(1); !result)
+                    return std::unexpected(result.error());
+
+            std::size_t inBytes = m_inputSize;
+            std::size_t outBytes = TINFL_LZ_DICT_SIZE - m_dictOffset;
+            const auto status = tinfl_decompress(&m_state->decompressor,
+                                                 &m_input[m_inputOffset], &inBytes,
+                                                 m_state->dict, &m_state->dict[m_dictOffset], &outBytes,
+                                                 m_flags | (m_inputEof ? 0 : TINFL_FLAG_HAS_MORE_INPUT));
+
+            m_inputOffset += inBytes;
+            m_inputSize -= inBytes;
+            m_pendingOffset = m_dictOffset;
+            m_pendingSize = outBytes;
+            m_dictOffset = (m_dictOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+            if (status == TINFL_STATUS_DONE)
+                m_stage = Stage::Done;
+            else if (status < 0)
+            {
+                ESP_LOGE(TAG, "tinfl_decompress() failed with %i", status);
+                return std::unexpected(status == TINFL_STATUS_ADLER32_MISMATCH ? ESP_ERR_INVALID_CRC : ESP_ERR_INVALID_RESPONSE);
+            }
+            else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && m_inputEof && !outBytes)
+            {
+                ESP_LOGE(TAG, "compressed stream truncated");
+                return std::unexpected(ESP_ERR_INVALID_SIZE);
+            }
+            continue;
+        }
+
+        case Stage::Done:
+            return 0;
+        }
+    }
+}
+
+void DecompressingOtaTransport::close()
+{
+    m_inner.close();
+
+    m_ownedInput.reset();
+    m_input = nullptr;
+    m_inputOffset = 0;
+    m_inputSize = 0;
+    m_inputEof = false;
+    m_state.reset();
+    m_dictOffset = 0;
+    m_pendingOffset = 0;
+    m_pendingSize = 0;
+}
+
+std::expected<void, esp_err_t> DecompressingOtaTransport::fill(std::size_t count)
+{
+    assert(count <= INPUT_SIZE);
+
+    while (m_inputSize < count && !m_inputEof)
+    {
+        if (m_inputOffset + m_inputSize == INPUT_SIZE || m_inputOffset + count > INPUT_SIZE)
+        {
+            std::memmove(&m_input[0], &m_input[m_inputOffset], m_inputSize);
+            m_inputOffset = 0;
+        }
+
+        const auto begin = m_inputOffset + m_inputSize;
+        const auto result = m_inner.read({&m_input[begin], INPUT_SIZE - begin});
+        if (!result)
+            return std::unexpected(result.error());
+
+        if (*result == 0)
+            m_inputEof = true;
+        else
+            m_inputSize += *result;
+    }
+
+    return {};
+}
+
+std::expected<void, esp_err_t> DecompressingOtaTransport::detect()
+{
+    if (const auto result = fill(2); !result)
+        return result;
+
+    if (m_inputSize >= 2 && m_input[m_inputOffset] == 0x1f && m_input[m_inputOffset + 1] == 0x8b)
+    {
+        m_detected = OtaCompression::Gzip;
+        m_stage = Stage::GzipHeader;
+    }
+    else
+        m_stage = Stage::Passthrough;
+
+    return {};
+}
+
+std::expected<void, esp_err_t> DecompressingOtaTransport::parseGzipHeader()
+{
+    // the header is only consumed once complete, so this can be retried after ESP_ERR_HTTP_EAGAIN
+    const auto require = [&](std::size_t count) -> std::expected<void, esp_err_t> {
+        if (count > INPUT_SIZE)
+            return std::unexpected(ESP_ERR_NOT_SUPPORTED);
+        if (const auto result = fill(count); !result)
+            return result;
+        if (m_inputSize < count)
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        return {};
+    };
+
+    if (const auto result = require(10); !result)
+        return result;
+
+    const auto at = [&](std::size_t pos){ return m_input[m_inputOffset + pos]; };
+
+    if (at(0) != 0x1f || at(1) != 0x8b || at(2) != 8)
+    {
+        ESP_LOGE(TAG, "invalid gzip header");
+        return std::unexpected(ESP_ERR_INVALID_RESPONSE);
+    }
+
+    const uint8_t flags = at(3);
+    std::size_t pos = 10;
+
+    if (flags & GZIP_FLAG_EXTRA)
+    {
+        if (const auto result = require(pos + 2); !result)
+            return result;
+        pos += 2 + (at(pos) | (at(pos + 1) << 8));
+    }
+
+    for (const auto flag : { GZIP_FLAG_NAME, GZIP_FLAG_COMMENT })
+    {
+        if (!(flags & flag))
+            continue;
+        while (true)
+        {
+            if (const auto result = require(pos + 1); !result)
+                return result;
+            if (at(pos++) == 0)
+                break;
+        }
+    }
+
+    if (flags & GZIP_FLAG_HCRC)
+        pos += 2;
+
+    if (const auto result = require(pos); !result)
+        return result;
+
+    m_inputOffset += pos;
+    m_inputSize -= pos;
+
+    return {};
+}
+
+std::size_t DecompressingOtaTransport::copyPending(std::span<uint8_t> buffer)
+{
+    const auto count = std::min(m_pendingSize, buffer.size());
+    std::memcpy(buffer.data(), &m_state->dict[m_pendingOffset], count);
+    m_pendingOffset += count;
+    m_pendingSize -= count;
+    return count;
+}
+
+esp_err_t DecompressingOtaTransport::startInflate(bool zlib)
+{
+    m_state.reset(new (std::nothrow) State);
+    if (!m_state)
+    {
+        ESP_LOGE(TAG, "could not allocate inflate state");
+        return ESP_ERR_NO_MEM;
+    }
+
+    tinfl_init(&m_state->decompressor);
+    m_flags = zlib ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+    m_dictOffset = 0;
+    m_stage = Stage::Inflate;
+
+    return ESP_OK;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// system includes
+#include <memory>
+#include <span>
+
+// local includes
+#include "cpptypesafeenum.h"
+#include "otatransport.h"
+
+#define OtaCompressionValues(x) \
+    x(Auto) \
+    x(None) \
+    x(Gzip) \
+    x(Zlib)
+DECLARE_TYPESAFE_ENUM(OtaCompression, : uint8_t, OtaCompressionValues)
+
+// Wraps another transport and inflates gzip or zlib compressed images on the fly.
+// RAM use is bounded by the 32 KiB deflate window plus a small input buffer.
+class DecompressingOtaTransport : public OtaTransport
+{
+public:
+    static constexpr std::size_t inputSize = 2048;
+
+    // without an input buffer of inputSize bytes one is allocated on open(),
+    // unless compression is None
+    DecompressingOtaTransport(OtaTransport &inner, OtaCompression compression, std::span<uint8_t> input = {});
+    ~DecompressingOtaTransport() override;
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override;
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override;
+    std::string_view contentEncoding() const override { return m_inner.contentEncoding(); }
+    std::string_view etag() const override { return m_inner.etag(); }
+    int statusCode() const override { return m_inner.statusCode(); }
+    std::optional<OtaConnectTimings> connectTimings() const override { return m_inner.connectTimings(); }
+    bool resumable() const override { return m_stage == Stage::Passthrough && m_inner.resumable(); }
+
+    OtaCompression detected() const { return m_detected; }
+
+private:
+    enum class Stage : uint8_t { Detect, GzipHeader, Inflate, Passthrough, Done };
+
+    struct State;
+
+    std::expected<void, esp_err_t> fill(std::size_t count);
+    std::expected<void, esp_err_t> detect();
+    std::expected<void, esp_err_t> parseGzipHeader();
+    std::size_t copyPending(std::span<uint8_t> buffer);
+    esp_err_t startInflate(bool zlib);
+
+    OtaTransport &m_inner;
+    const OtaCompression m_compression;
+    OtaCompression m_detected{OtaCompression::None};
+    Stage m_stage{Stage::Detect};
+
+    const std::span<uint8_t> m_staticInput;
+    std::unique_ptr<uint8_t[]> m_ownedInput;
+    uint8_t *m_input{};
+    std::size_t m_inputOffset{};
+    std::size_t m_inputSize{};
+    bool m_inputEof{};
+
+    std::unique_ptr<State> m_state;
+    std::size_t m_dictOffset{};
+    std::size_t m_pendingOffset{};
+    std::size_t m_pendingSize{};
+    uint32_t m_flags{};
+};
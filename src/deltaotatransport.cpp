@@ -0,0 +1,290 @@
+#include "deltaotatransport.h"
+
+// system includes
+#include <algorithm>
+#include <cstring>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_http_client.h>
+
+// local includes
+#include "otautils.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr std::array<uint8_t, 4> PATCH_MAGIC{'E', 'A', 'D', '1'};
+constexpr std::size_t PATCH_HEADER_SIZE = 4 + 4 + 32;
+constexpr int MAX_OPEN_RETRIES = 3;
+
+std::size_t recordHeaderSize(char op)
+{
+    switch (op)
+    {
+    case 'C':
+    case 'D': return 1 + 4 + 4;
+    case 'X': return 1 + 4;
+    case 'E': return 1;
+    default: return 0;
+    }
+}
+} // namespace
+
+DeltaOtaTransport::DeltaOtaTransport(OtaTransport &patch, OtaTransport *fallback) :
+    m_patch{patch},
+    m_fallback{fallback}
+{
+}
+
+DeltaOtaTransport::~DeltaOtaTransport()
+{
+    close();
+}
+
+esp_err_t DeltaOtaTransport::open(std::size_t offset)
+{
+    close();
+
+    if (offset)
+    {
+        // resuming is only possible once the fallback full image is in use
+        if (!m_usingFallback)
+        {
+            ESP_LOGE(TAG, "delta patches cannot be opened at an offset");
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        return m_fallback->open(offset);
+    }
+
+    m_usingFallback = false;
+
+    const auto result = openPatch();
+    if (result != ESP_ERR_INVALID_VERSION)
+        return result;
+
+    m_patch.close();
+
+    if (!m_fallback)
+        return result;
+
+    ESP_LOGW(TAG, "falling back to full image download");
+    m_usingFallback = true;
+    return m_fallback->open(0);
+}
+
+std::optional<std::size_t> DeltaOtaTransport::contentLength() const
+{
+    if (m_usingFallback)
+        return m_fallback->contentLength();
+    if (m_base)
+        return m_targetSize;
+    return std::nullopt;
+}
+
+std::expected<std::size_t, esp_err_t> DeltaOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (m_usingFallback)
+        return m_fallback->read(buffer);
+
+    if (!m_base)
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+
+    while (!m_remaining)
+    {
+        if (m_finished)
+            return 0;
+
+        if (const auto result = readRecord(); !result)
+            return std::unexpected(result.error());
+    }
+
+    auto chunk = buffer.first(std::min(buffer.size(), m_remaining));
+
+    switch (m_op)
+    {
+    case 'C':
+        if (const auto result = esp_partition_read(m_base, m_baseOffset, chunk.data(), chunk.size()); result != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_partition_read() failed with %s", esp_err_to_name(result));
+            return std::unexpected(result);
+        }
+        break;
+
+    case 'D':
+    {
+        chunk = chunk.first(std::min(chunk.size(), m_scratch.size()));
+
+        const auto read = m_patch.read(chunk);
+        if (!read)
+            return std::unexpected(read.error());
+        if (*read == 0)
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        chunk = chunk.first(*read);
+
+        if (const auto result = esp_partition_read(m_base, m_baseOffset, m_scratch.data(), chunk.size()); result != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_partition_read() failed with %s", esp_err_to_name(result));
+            return std::unexpected(result);
+        }
+
+        for (std::size_t i = 0; i < chunk.size(); i++)
+            chunk[i] += m_scratch[i];
+        break;
+    }
+
+    case 'X':
+    {
+        const auto read = m_patch.read(chunk);
+        if (!read)
+            return std::unexpected(read.error());
+        if (*read == 0)
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        chunk = chunk.first(*read);
+        break;
+    }
+    }
+
+    m_baseOffset += chunk.size();
+    m_remaining -= chunk.size();
+    m_produced += chunk.size();
+
+    if (m_produced > m_targetSize)
+    {
+        ESP_LOGE(TAG, "patch produces more than %zd bytes", m_targetSize);
+        return std::unexpected(ESP_ERR_INVALID_SIZE);
+    }
+
+    return chunk.size();
+}
+
+void DeltaOtaTransport::close()
+{
+    m_patch.close();
+    if (m_fallback)
+        m_fallback->close();
+
+    m_base = nullptr;
+    m_targetSize = 0;
+    m_produced = 0;
+    m_headerSize = 0;
+    m_op = {};
+    m_baseOffset = 0;
+    m_remaining = 0;
+    m_finished = false;
+}
+
+std::expected<void, esp_err_t> DeltaOtaTransport::fillHeader(std::size_t count)
+{
+    // partially received headers are kept, so this can be retried after ESP_ERR_HTTP_EAGAIN
+    while (m_headerSize < count)
+    {
+        const auto read = m_patch.read(std::span{m_header}.subspan(m_headerSize, count - m_headerSize));
+        if (!read)
+            return std::unexpected(read.error());
+        if (*read == 0)
+        {
+            ESP_LOGE(TAG, "patch truncated");
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        }
+        m_headerSize += *read;
+    }
+
+    return {};
+}
+
+std::expected<void, esp_err_t> DeltaOtaTransport::readRecord()
+{
+    if (const auto result = fillHeader(1); !result)
+        return result;
+
+    const char op = m_header[0];
+    const auto size = recordHeaderSize(op);
+    if (!size)
+    {
+        ESP_LOGE(TAG, "invalid patch record 0x%02x", m_header[0]);
+        return std::unexpected(ESP_ERR_INVALID_RESPONSE);
+    }
+
+    if (const auto result = fillHeader(size); !result)
+        return result;
+    m_headerSize = 0;
+
+    m_op = op;
+    switch (op)
+    {
+    case 'C':
+    case 'D':
+        m_baseOffset = readLe32(&m_header[1]);
+        m_remaining = readLe32(&m_header[5]);
+        if (m_baseOffset + m_remaining > m_base->size)
+        {
+            ESP_LOGE(TAG, "patch record exceeds base partition");
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        }
+        break;
+    case 'X':
+        m_remaining = readLe32(&m_header[1]);
+        break;
+    case 'E':
+        if (m_produced != m_targetSize)
+        {
+            ESP_LOGE(TAG, "patch produced %zd of %zd bytes", m_produced, m_targetSize);
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        }
+        m_finished = true;
+        break;
+    }
+
+    return {};
+}
+
+esp_err_t DeltaOtaTransport::openPatch()
+{
+    if (const auto result = m_patch.open(0); result != ESP_OK)
+        return result;
+
+    for (int retries = 0; ; retries++)
+    {
+        const auto result = fillHeader(PATCH_HEADER_SIZE);
+        if (result)
+            break;
+        if (result.error() != ESP_ERR_HTTP_EAGAIN || retries >= MAX_OPEN_RETRIES)
+            return result.error();
+    }
+    m_headerSize = 0;
+
+    if (!std::equal(std::begin(PATCH_MAGIC), std::end(PATCH_MAGIC), std::begin(m_header)))
+    {
+        ESP_LOGE(TAG, "invalid patch magic");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    const auto base = esp_ota_get_running_partition();
+    if (!base)
+    {
+        ESP_LOGE(TAG, "could not get running partition");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t sha256[32];
+    if (const auto result = esp_partition_get_sha256(base, sha256); result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_partition_get_sha256() failed with %s", esp_err_to_name(result));
+        return result;
+    }
+
+    if (std::memcmp(sha256, &m_header[8], sizeof(sha256)) != 0)
+    {
+        ESP_LOGW(TAG, "patch base does not match running image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    m_base = base;
+    m_targetSize = readLe32(&m_header[4]);
+
+    ESP_LOGI(TAG, "applying patch against %s, target size %zd", m_base->label, m_targetSize);
+
+    return ESP_OK;
+}
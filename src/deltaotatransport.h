@@ -0,0 +1,65 @@
+#pragma once
+
+// system includes
+#include <array>
+
+// esp-idf includes
+#include <esp_partition.h>
+
+// local includes
+#include "otatransport.h"
+
+// Reconstructs a new image from a patch against the running app partition.
+//
+// Patch layout (all integers little endian):
+//   header: "EAD1", u32 target size, u8[32] sha256 of the running image
+//   records: 'C' u32 base offset, u32 length               copy from base
+//            'D' u32 base offset, u32 length, u8[length]    base + diff (bytewise, mod 256)
+//            'X' u32 length, u8[length]                     literal bytes
+//            'E'                                            end of patch
+//
+// When the base hash does not match the running image, the fallback transport
+// (if any) is opened instead and passed through unchanged.
+class DeltaOtaTransport : public OtaTransport
+{
+public:
+    DeltaOtaTransport(OtaTransport &patch, OtaTransport *fallback);
+    ~DeltaOtaTransport() override;
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override;
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override;
+    std::string_view contentEncoding() const override { return current().contentEncoding(); }
+    std::string_view etag() const override { return current().etag(); }
+    int statusCode() const override { return current().statusCode(); }
+    std::optional<OtaConnectTimings> connectTimings() const override { return current().connectTimings(); }
+    bool resumable() const override { return m_usingFallback && m_fallback->resumable(); }
+
+    bool usingFallback() const { return m_usingFallback; }
+
+private:
+    OtaTransport &current() const { return m_usingFallback ? *m_fallback : m_patch; }
+
+    std::expected<void, esp_err_t> fillHeader(std::size_t count);
+    std::expected<void, esp_err_t> readRecord();
+    esp_err_t openPatch();
+
+    OtaTransport &m_patch;
+    OtaTransport * const m_fallback;
+    bool m_usingFallback{};
+
+    const esp_partition_t *m_base{};
+    std::size_t m_targetSize{};
+    std::size_t m_produced{};
+
+    std::array<uint8_t, 40> m_header;
+    std::size_t m_headerSize{};
+
+    char m_op{};
+    std::size_t m_baseOffset{};
+    std::size_t m_remaining{};
+    bool m_finished{};
+
+    std::array<uint8_t, 256> m_scratch;
+};
@@ -3,25 +3,36 @@
 #include "sdkconfig.h"
 
 // system includes
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
 
 // esp-idf includes
 #include <esp_log.h>
-#include <esp_http_client.h>
-#include <esp_https_ota.h>
+#include <esp_app_format.h>
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
 #if defined(CONFIG_ESP_TASK_WDT_PANIC) || defined(CONFIG_ESP_TASK_WDT)
 #include <freertos/task.h>
 #include <esp_task_wdt.h>
 #endif
-#include <esp_crt_bundle.h>
 
 // local includes
 #include "cleanuphelper.h"
 #include "esphttpdutils.h"
 #include "tickchrono.h"
+#include "otacheckpoint.h"
 
 using namespace std::chrono_literals;
 
+ESP_EVENT_DEFINE_BASE(ESPASYNCOTA_EVENTS);
+
 namespace {
 constexpr const char * const TAG = "ASYNC_OTA";
 
@@ -34,6 +45,139 @@ constexpr int REQUEST_SUCCEEDED_BIT = BIT5;
 constexpr int END_TASK_BIT = BIT6;
 constexpr int TASK_ENDED_BIT = BIT7;
 constexpr int ABORT_REQUEST_BIT = BIT8;
+constexpr int REQUEST_SKIPPED_BIT = BIT9;
+
+constexpr std::chrono::milliseconds MAX_RETRY_BACKOFF = 30s;
+
+// how long a finished job stays reported before the task restarts or goes idle
+constexpr std::chrono::milliseconds FINISHED_LINGER = 5s;
+
+constexpr std::size_t CHECKPOINT_ALIGNMENT = 4096;
+
+constexpr std::size_t IMAGE_HEADER_SIZE = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
+
+// one checkpoint per partition, nvs keys are limited to 15 characters
+std::array<char, 16> checkpointKey(const esp_partition_t &partition)
+{
+    std::array<char, 16> key;
+    std::snprintf(key.data(), key.size(), "ckpt%08lx", partition.address);
+    return key;
+}
+
+std::chrono::microseconds timestamp()
+{
+    return std::chrono::microseconds{esp_timer_get_time()};
+}
+
+// only with the esp_timer as run time clock the counter is in microseconds, the
+// cpu clock ticks at the core frequency and wraps within seconds
+std::optional<std::chrono::microseconds> cpuTimestamp()
+{
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1 && defined(CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER)
+    TaskStatus_t status;
+    vTaskGetInfo(NULL, &status, pdFALSE, eRunning);
+#ifdef CONFIG_FREERTOS_RUN_TIME_COUNTER_TYPE_U64
+    return std::chrono::microseconds{int64_t(status.ulRunTimeCounter)};
+#else
+    // a 32 bit counter wraps after about 71 minutes of cpu time, widened per
+    // task since the counter belongs to the calling task
+    thread_local uint32_t last{};
+    thread_local uint64_t wraps{};
+    if (status.ulRunTimeCounter < last)
+        wraps += uint64_t{1} << 32;
+    last = status.ulRunTimeCounter;
+    return std::chrono::microseconds{int64_t(wraps + last)};
+#endif
+#else
+    return std::nullopt;
+#endif
+}
+
+bool isRetryable(esp_err_t error)
+{
+    switch (error)
+    {
+    case ESP_FAIL:
+    case ESP_ERR_TIMEOUT:
+    case ESP_ERR_HTTP_CONNECT:
+    case ESP_ERR_HTTP_FETCH_HEADER:
+    case ESP_ERR_HTTP_EAGAIN:
+    case ESP_ERR_HTTP_INCOMPLETE_DATA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::optional<esp_app_desc_t> parseAppDesc(std::span<const uint8_t, IMAGE_HEADER_SIZE> header)
+{
+    if (header[0] != ESP_IMAGE_HEADER_MAGIC)
+    {
+        ESP_LOGW(TAG, "invalid image header magic 0x%02x", header[0]);
+        return std::nullopt;
+    }
+
+    esp_app_desc_t appDesc;
+    std::memcpy(&appDesc, header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(appDesc));
+    if (appDesc.magic_word != ESP_APP_DESC_MAGIC_WORD)
+    {
+        ESP_LOGW(TAG, "invalid app desc magic 0x%08lx", appDesc.magic_word);
+        return std::nullopt;
+    }
+
+    ESP_LOGI(TAG, "new firmware version: %s", appDesc.version);
+    return appDesc;
+}
+
+UBaseType_t priorityFor(const OtaTaskPriorities &priorities, OtaCloudUpdateStatus phase)
+{
+    switch (phase)
+    {
+    case OtaCloudUpdateStatus::Updating: return priorities.download;
+    case OtaCloudUpdateStatus::Verifying: return priorities.finish;
+    default: return priorities.idle;
+    }
+}
+
+// compares dotted numeric versions like "v1.2.3-dirty", nullopt if either is not one
+std::optional<int> compareVersions(std::string_view a, std::string_view b)
+{
+    const auto parse = [](std::string_view version) -> std::optional<std::array<unsigned, 4>> {
+        if (version.starts_with('v'))
+            version.remove_prefix(1);
+
+        std::array<unsigned, 4> parts{};
+        const char *iter = version.data();
+        const char * const end = version.data() + version.size();
+        for (std::size_t i = 0; i < parts.size(); i++)
+        {
+            const auto [ptr, ec] = std::from_chars(iter, end, parts[i]);
+            if (ec != std::errc{})
+            {
+                if (!i)
+                    return std::nullopt;
+                break;
+            }
+            iter = ptr;
+            if (iter == end || *iter != '.')
+                break;
+            iter++;
+        }
+        return parts;
+    };
+
+    const auto partsA = parse(a);
+    const auto partsB = parse(b);
+    if (!partsA || !partsB)
+        return std::nullopt;
+
+    return *partsA < *partsB ? -1 : *partsA > *partsB ? 1 : 0;
+}
+
+std::string_view descField(const char *field, std::size_t size)
+{
+    return {field, strnlen(field, size)};
+}
 } // namespace
 
 EspAsyncOta::EspAsyncOta(const char *taskName, uint32_t stackSize, espcpputils::CoreAffinity coreAffinity) :
@@ -65,9 +209,13 @@ std::expected<void, std::string> EspAsyncOta::startTask()
         return std::unexpected(msg);
     }
 
-    m_eventGroup.clearBits(TASK_RUNNING_BIT | START_REQUEST_BIT | REQUEST_RUNNING_BIT | REQUEST_VERIFYING_BIT | REQUEST_FINISHED_BIT | REQUEST_SUCCEEDED_BIT | END_TASK_BIT | TASK_ENDED_BIT | ABORT_REQUEST_BIT);
+    m_eventGroup.clearBits(TASK_RUNNING_BIT | START_REQUEST_BIT | REQUEST_RUNNING_BIT | REQUEST_VERIFYING_BIT | REQUEST_FINISHED_BIT | REQUEST_SUCCEEDED_BIT | END_TASK_BIT | TASK_ENDED_BIT | ABORT_REQUEST_BIT | REQUEST_SKIPPED_BIT);
 
-    const auto result = espcpputils::createTask(otaTask, m_taskName, m_stackSize, this, 10, &m_taskHandle, m_coreAffinity);
+    BaseType_t result{pdPASS};
+    if (m_staticTask)
+        m_taskHandle = createOtaStaticTask(otaTask, m_taskName, *m_staticTask, this, m_priorities.load().idle, m_coreAffinity);
+    else
+        result = espcpputils::createTask(otaTask, m_taskName, m_stackSize, this, m_priorities.load().idle, &m_taskHandle, m_coreAffinity);
     if (result != pdPASS)
     {
         auto msg = std::format("failed creating ota task {}", result);
@@ -149,6 +297,8 @@ OtaCloudUpdateStatus EspAsyncOta::status() const
     {
         if (bits & REQUEST_SUCCEEDED_BIT)
             return OtaCloudUpdateStatus::Succeeded;
+        else if (bits & REQUEST_SKIPPED_BIT)
+            return OtaCloudUpdateStatus::Skipped;
         else
             return OtaCloudUpdateStatus::Failed;
     }
@@ -157,7 +307,311 @@ OtaCloudUpdateStatus EspAsyncOta::status() const
 }
 
 std::expected<void, std::string> EspAsyncOta::trigger(std::string_view url, std::string_view cert_pem, bool use_global_ca,
-                                                      std::string_view client_key, std::string_view client_cert)
+                                                      std::string_view client_key, std::string_view client_cert,
+                                                      const OtaTriggerOptions &options)
+{
+    std::lock_guard lock{m_jobMutex};
+    if (auto result = ensureIdle(); !result)
+        return result;
+
+    if (url.empty())
+        return std::unexpected("empty firmware url");
+
+    if (const auto result = esphttpdutils::urlverify(url); !result)
+        return std::unexpected(std::format("could not verify firmware url: {}", result.error()));
+
+    const auto sink = prepareHttpJob(cert_pem, use_global_ca, client_key, client_cert, options);
+    if (!sink)
+        return std::unexpected(sink.error());
+
+    m_httpTransport.emplace(url, cert_pem, use_global_ca, client_key, client_cert);
+
+    return startJob(*m_httpTransport, **sink, options, m_fallbackHttpTransport ? &*m_fallbackHttpTransport : nullptr,
+                    m_signatureHttpTransport ? &*m_signatureHttpTransport : nullptr, nullptr);
+}
+
+std::expected<void, std::string> EspAsyncOta::triggerManifest(std::string_view manifestUrl, std::string_view cert_pem, bool use_global_ca,
+                                                              std::string_view client_key, std::string_view client_cert,
+                                                              const OtaTriggerOptions &options)
+{
+    std::lock_guard lock{m_jobMutex};
+    if (auto result = ensureIdle(); !result)
+        return result;
+
+    if (manifestUrl.empty())
+        return std::unexpected("empty manifest url");
+
+    if (const auto result = esphttpdutils::urlverify(manifestUrl); !result)
+        return std::unexpected(std::format("could not verify manifest url: {}", result.error()));
+
+    const auto sink = prepareHttpJob(cert_pem, use_global_ca, client_key, client_cert, options);
+    if (!sink)
+        return std::unexpected(sink.error());
+
+    m_manifestHttpTransport.emplace(manifestUrl, cert_pem, use_global_ca, client_key, client_cert);
+    m_mirrorTransport.emplace(cert_pem, use_global_ca, client_key, client_cert);
+
+    return startJob(*m_mirrorTransport, **sink, options, m_fallbackHttpTransport ? &*m_fallbackHttpTransport : nullptr,
+                    m_signatureHttpTransport ? &*m_signatureHttpTransport : nullptr, &*m_manifestHttpTransport);
+}
+
+std::expected<void, std::string> EspAsyncOta::trigger(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                                                      OtaTransport *fallbackTransport, OtaTransport *signatureTransport)
+{
+    std::lock_guard lock{m_jobMutex};
+    if (auto result = ensureIdle(); !result)
+        return result;
+
+    m_httpCredentials = std::nullopt;
+
+    return startJob(transport, sink, options, fallbackTransport, signatureTransport, nullptr);
+}
+
+std::expected<void, std::string> EspAsyncOta::triggerUpload(httpd_req_t *req, const OtaTriggerOptions &options)
+{
+    std::lock_guard lock{m_jobMutex};
+    if (auto result = ensureIdle(); !result)
+        return result;
+
+    if (!req)
+        return std::unexpected("no request");
+
+    const auto sink = prepareSink(options);
+    if (!sink)
+        return std::unexpected(sink.error());
+
+    httpd_req_t *detached{};
+    if (const auto result = httpd_req_async_handler_begin(req, &detached); result != ESP_OK)
+        return std::unexpected(std::format("httpd_req_async_handler_begin() failed with {}", esp_err_to_name(result)));
+
+    m_uploadTransport.emplace(detached);
+    m_httpCredentials = std::nullopt;
+
+    return startJob(*m_uploadTransport, **sink, options, nullptr, nullptr, nullptr);
+}
+
+std::expected<OtaSink *, std::string> EspAsyncOta::prepareHttpJob(std::string_view cert_pem, bool use_global_ca,
+                                                                   std::string_view client_key, std::string_view client_cert,
+                                                                   const OtaTriggerOptions &options)
+{
+    if (!options.fallbackUrl.empty())
+    {
+        if (const auto result = esphttpdutils::urlverify(options.fallbackUrl); !result)
+            return std::unexpected(std::format("could not verify fallback url: {}", result.error()));
+    }
+
+    if (!options.signatureUrl.empty())
+    {
+        if (const auto result = esphttpdutils::urlverify(options.signatureUrl); !result)
+            return std::unexpected(std::format("could not verify signature url: {}", result.error()));
+    }
+
+    const auto sink = prepareSink(options);
+    if (!sink)
+        return sink;
+
+    if (!options.fallbackUrl.empty())
+        m_fallbackHttpTransport.emplace(options.fallbackUrl, cert_pem, use_global_ca, client_key, client_cert);
+    else
+        m_fallbackHttpTransport = std::nullopt;
+    if (!options.signatureUrl.empty())
+        m_signatureHttpTransport.emplace(options.signatureUrl, cert_pem, use_global_ca, client_key, client_cert);
+    else
+        m_signatureHttpTransport = std::nullopt;
+
+    m_httpCredentials = HttpCredentials {
+        .cert_pem = cert_pem,
+        .use_global_ca = use_global_ca,
+        .client_key = client_key,
+        .client_cert = client_cert
+    };
+
+    return sink;
+}
+
+std::expected<OtaSink *, std::string> EspAsyncOta::prepareSink(const OtaTriggerOptions &options)
+{
+    const esp_partition_t *partition{};
+    if (!options.partitionLabel.empty())
+    {
+        partition = PartitionOtaSink::find(options.partitionLabel);
+        if (!partition)
+            return std::unexpected(std::format("partition {} not found", options.partitionLabel));
+    }
+    else if (options.dataSubtype)
+    {
+        partition = PartitionOtaSink::find(*options.dataSubtype);
+        if (!partition)
+            return std::unexpected(std::format("no data partition with subtype {:#x}", int(*options.dataSubtype)));
+    }
+
+    if (partition && partition->type != ESP_PARTITION_TYPE_APP)
+    {
+        m_appSink = std::nullopt;
+        return &m_partitionSink.emplace(partition);
+    }
+
+    m_partitionSink = std::nullopt;
+    return &m_appSink.emplace(partition);
+}
+
+std::expected<void, std::string> EspAsyncOta::startJob(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                                                       OtaTransport *fallbackTransport, OtaTransport *signatureTransport,
+                                                       OtaTransport *manifestTransport, uint32_t jobId)
+{
+    if (signatureTransport && options.signaturePublicKey.empty())
+        return std::unexpected("signature verification requires a public key");
+
+    loadJob(transport, sink, options, fallbackTransport, signatureTransport, manifestTransport, jobId);
+
+    m_eventGroup.setBits(START_REQUEST_BIT);
+    ESP_LOGI(TAG, "ota cloud update triggered");
+
+    return {};
+}
+
+void EspAsyncOta::loadJob(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                          OtaTransport *fallbackTransport, OtaTransport *signatureTransport,
+                          OtaTransport *manifestTransport, uint32_t jobId)
+{
+    m_jobLoaded = true;
+    m_jobId = jobId;
+    m_transport = &transport;
+    m_sink = &sink;
+    m_fallbackTransport = fallbackTransport;
+    m_signatureTransport = signatureTransport;
+    m_manifestTransport = manifestTransport;
+    m_signaturePublicKey = options.signaturePublicKey;
+    m_options = options;
+    m_options.fallbackUrl = {};
+    m_options.signatureUrl = {};
+    m_options.signaturePublicKey = {};
+}
+
+std::expected<uint32_t, std::string> EspAsyncOta::enqueue(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                                                          int priority, OtaTransport *fallbackTransport,
+                                                          OtaTransport *signatureTransport)
+{
+    if (!m_taskHandle)
+    {
+        if (auto result = startTask(); !result)
+            return std::unexpected(std::move(result).error());
+    }
+
+    if (signatureTransport && options.signaturePublicKey.empty())
+        return std::unexpected("signature verification requires a public key");
+
+    std::lock_guard lock{m_jobMutex};
+
+    if (!m_jobLoaded && !m_queueSize)
+    {
+        m_eventGroup.clearBits(REQUEST_FINISHED_BIT | REQUEST_SUCCEEDED_BIT | REQUEST_SKIPPED_BIT);
+        m_finishedTs = std::nullopt;
+        m_httpCredentials = std::nullopt;
+        const auto id = ++m_lastJobId;
+        if (auto result = startJob(transport, sink, options, fallbackTransport, signatureTransport, nullptr, id); !result)
+            return std::unexpected(std::move(result).error());
+        return id;
+    }
+
+    if (m_queueSize == m_queue.size())
+        return std::unexpected("ota job queue full");
+
+    const auto id = ++m_lastJobId;
+
+    // stable, jobs of equal priority run in the order they were queued
+    auto iter = std::begin(m_queue) + m_queueSize;
+    for (; iter != std::begin(m_queue) && std::prev(iter)->priority < priority; --iter)
+        *iter = std::move(*std::prev(iter));
+    *iter = QueuedJob {
+        .transport = &transport,
+        .sink = &sink,
+        .options = options,
+        .fallbackTransport = fallbackTransport,
+        .signatureTransport = signatureTransport,
+        .priority = priority,
+        .id = id
+    };
+    m_queueSize++;
+
+    ESP_LOGI(TAG, "ota job %lu queued with priority %i (%zd waiting)", id, priority, m_queueSize);
+
+    return id;
+}
+
+std::size_t EspAsyncOta::queuedJobs() const
+{
+    std::lock_guard lock{m_jobMutex};
+    return m_queueSize;
+}
+
+void EspAsyncOta::clearQueue()
+{
+    std::lock_guard lock{m_jobMutex};
+    m_queueSize = 0;
+}
+
+std::optional<OtaJobResult> EspAsyncOta::jobResult(uint32_t id) const
+{
+    std::lock_guard lock{m_jobMutex};
+
+    for (const auto &result : m_jobResults)
+        if (id && result.id == id)
+            return result;
+
+    return std::nullopt;
+}
+
+void EspAsyncOta::recordJobResult(OtaCloudUpdateStatus status)
+{
+    if (!m_jobId)
+        return;
+
+    const OtaJobResult result {
+        .id = m_jobId,
+        .status = status,
+        .skipReason = m_skipReason,
+        .error = m_error
+    };
+
+    {
+        std::lock_guard lock{m_jobMutex};
+        m_jobResults[m_nextJobResult] = result;
+        m_nextJobResult = (m_nextJobResult + 1) % m_jobResults.size();
+    }
+
+    if (!m_eventConfig.enabled)
+        return;
+
+    if (const auto posted = m_eventConfig.loop ?
+            esp_event_post_to(m_eventConfig.loop, ESPASYNCOTA_EVENTS, ESPASYNCOTA_EVENT_JOB_FINISHED, &result, sizeof(result), 0) :
+            esp_event_post(ESPASYNCOTA_EVENTS, ESPASYNCOTA_EVENT_JOB_FINISHED, &result, sizeof(result), 0);
+        posted != ESP_OK)
+        ESP_LOGW(TAG, "posting the result of job %lu failed with %s", result.id, esp_err_to_name(posted));
+}
+
+bool EspAsyncOta::startQueuedJob()
+{
+    std::lock_guard lock{m_jobMutex};
+
+    if (!m_queueSize)
+        return false;
+
+    const auto job = m_queue.front();
+    std::move(std::begin(m_queue) + 1, std::begin(m_queue) + m_queueSize, std::begin(m_queue));
+    m_queueSize--;
+
+    m_eventGroup.clearBits(REQUEST_FINISHED_BIT | REQUEST_SUCCEEDED_BIT | REQUEST_SKIPPED_BIT);
+    m_httpCredentials = std::nullopt;
+    loadJob(*job.transport, *job.sink, job.options, job.fallbackTransport, job.signatureTransport, nullptr, job.id);
+
+    ESP_LOGI(TAG, "starting queued ota job %lu (%zd waiting)", job.id, m_queueSize);
+
+    return true;
+}
+
+// called with m_jobMutex held, so the queue cannot hand the task a job in between
+std::expected<void, std::string> EspAsyncOta::ensureIdle()
 {
     if (!m_taskHandle)
     {
@@ -167,28 +621,13 @@ std::expected<void, std::string> EspAsyncOta::trigger(std::string_view url, std:
 
     if (const auto bits = m_eventGroup.getBits(); !(bits & TASK_RUNNING_BIT))
         return std::unexpected("ota cloud task not running");
-    else if (bits & (START_REQUEST_BIT | REQUEST_RUNNING_BIT))
+    else if (m_jobLoaded || m_queueSize || (bits & (START_REQUEST_BIT | REQUEST_RUNNING_BIT)))
         return std::unexpected("ota cloud already running");
     else if (bits & REQUEST_FINISHED_BIT)
         return std::unexpected("ota cloud not fully finished, try again");
     else
         assert(!(bits & REQUEST_SUCCEEDED_BIT));
 
-    if (url.empty())
-        return std::unexpected("empty firmware url");
-
-    if (const auto result = esphttpdutils::urlverify(url); !result)
-        return std::unexpected(std::format("could not verify firmware url: {}", result.error()));
-
-    m_url = std::string{url};
-    m_cert_pem = cert_pem;
-    m_use_global_ca = use_global_ca;
-    m_client_key = client_key;
-    m_client_cert = client_cert;
-
-    m_eventGroup.setBits(START_REQUEST_BIT);
-    ESP_LOGI(TAG, "ota cloud update triggered");
-
     return {};
 }
 
@@ -205,6 +644,43 @@ std::expected<void, std::string> EspAsyncOta::abort()
     return {};
 }
 
+void EspAsyncOta::setPipeline(std::size_t blockCount, std::size_t blockSize, std::optional<espcpputils::CoreAffinity> writerCoreAffinity)
+{
+    assert(blockSize);
+
+    m_pipelineBlockCount = blockCount;
+    m_pipelineBlockSize = blockSize;
+    m_writerCoreAffinity = writerCoreAffinity;
+    m_staticPipeline = std::nullopt;
+}
+
+void EspAsyncOta::setPriorities(const OtaTaskPriorities &priorities)
+{
+    // keeps the task priority in step with the last stored set
+    std::lock_guard lock{m_priorityMutex};
+    m_priorities.store(priorities);
+
+    if (!m_taskHandle)
+        return;
+
+    vTaskPrioritySet(m_taskHandle, priorityFor(priorities, status()));
+}
+
+void EspAsyncOta::setStaticStorage(OtaStaticTaskStorage task, const OtaBlockPipeline::Storage &pipeline, std::size_t blockCount, std::size_t blockSize,
+                                   std::span<uint8_t> decompressInput)
+{
+    assert(!m_taskHandle);
+    assert(blockSize);
+
+    m_staticTask = task;
+    m_staticPipeline = pipeline;
+    m_staticDecompressInput = decompressInput;
+    m_pipelineBlockCount = blockCount;
+    m_pipelineBlockSize = blockSize;
+
+    ESP_LOGI(TAG, "static storage: task stack %zd, %zd blocks of %zd bytes", task.stack.size(), blockCount, blockSize);
+}
+
 void EspAsyncOta::update()
 {
     //if (!m_taskHandle)
@@ -218,6 +694,9 @@ void EspAsyncOta::update()
 
     if (const auto bits = m_eventGroup.getBits(); bits & (START_REQUEST_BIT | REQUEST_RUNNING_BIT))
     {
+        // a queued job may have started right after the previous one finished
+        m_finishedTs = std::nullopt;
+
         if (!m_lastInfo || espchrono::ago(*m_lastInfo) >= 1s)
         {
             m_lastInfo = espchrono::millis_clock::now();
@@ -243,21 +722,8 @@ void EspAsyncOta::update()
     }
     else if (bits & REQUEST_FINISHED_BIT)
     {
-        if (m_finishedTs)
-        {
-            if (espchrono::ago(*m_finishedTs) > 5s)
-            {
-                m_finishedTs = std::nullopt;
-
-                if (bits & REQUEST_SUCCEEDED_BIT)
-                    esp_restart();
-
-                m_eventGroup.clearBits(REQUEST_FINISHED_BIT|REQUEST_SUCCEEDED_BIT);
-
-                m_appDesc = std::nullopt;
-            }
-        }
-        else
+        // the restart and the return to idle are up to the ota task, this only logs
+        if (!m_finishedTs)
         {
             m_finishedTs = espchrono::millis_clock::now();
             if (m_totalSize)
@@ -266,6 +732,143 @@ void EspAsyncOta::update()
                 ESP_LOGI(TAG, "OTA Finished %i of unknown", m_progress);
         }
     }
+    else
+        m_finishedTs = std::nullopt;
+}
+
+void EspAsyncOta::publishSnapshot(OtaCloudUpdateStatus phase)
+{
+    const std::optional<std::size_t> totalSize = m_totalSize ? std::optional<std::size_t>{*m_totalSize} : std::nullopt;
+
+    if (phase == OtaCloudUpdateStatus::Updating)
+        m_rateEstimator.sample(m_progress, timestamp());
+
+    const OtaProgressSnapshot snapshot {
+        .phase = phase,
+        .bytesRead = std::size_t(m_progress),
+        .totalSize = totalSize,
+        .rate = m_rateEstimator.averageRate(),
+        .instantRate = m_rateEstimator.instantRate(),
+        .eta = phase == OtaCloudUpdateStatus::Updating ? m_rateEstimator.eta(m_progress, totalSize) : std::nullopt,
+        .errorCode = m_error.error
+    };
+
+    m_snapshot.store(snapshot);
+
+    if (m_eventConfig.enabled)
+        postEvents(snapshot);
+}
+
+void EspAsyncOta::postEvents(const OtaProgressSnapshot &snapshot)
+{
+    // events are posted without waiting; when the queue is full the latest
+    // snapshot is retried on the next publish instead, coalescing the backlog
+    const auto post = [&](int32_t id){
+        const auto result = m_eventConfig.loop ?
+            esp_event_post_to(m_eventConfig.loop, ESPASYNCOTA_EVENTS, id, &snapshot, sizeof(snapshot), 0) :
+            esp_event_post(ESPASYNCOTA_EVENTS, id, &snapshot, sizeof(snapshot), 0);
+        return result == ESP_OK;
+    };
+
+    const auto now = timestamp();
+
+    if (snapshot.phase != m_lastEventPhase)
+    {
+        m_phaseEventPending = true;
+        m_lastEventPhase = snapshot.phase;
+    }
+
+    if (m_phaseEventPending)
+    {
+        if (post(ESPASYNCOTA_EVENT_PHASE))
+        {
+            m_phaseEventPending = false;
+            m_progressEventPending = false;
+            m_lastEventBytes = snapshot.bytesRead;
+            m_lastEventTs = now;
+        }
+        return;
+    }
+
+    if (!m_progressEventPending)
+    {
+        const bool bytesDue = m_eventConfig.everyBytes && snapshot.bytesRead >= m_lastEventBytes + m_eventConfig.everyBytes;
+        const bool timeDue = m_eventConfig.everyInterval.count() > 0 && now - m_lastEventTs >= m_eventConfig.everyInterval;
+        if (!bytesDue && !timeDue)
+            return;
+        m_progressEventPending = true;
+    }
+
+    if (post(ESPASYNCOTA_EVENT_PROGRESS))
+    {
+        m_progressEventPending = false;
+        m_lastEventBytes = snapshot.bytesRead;
+        m_lastEventTs = now;
+    }
+}
+
+std::expected<OtaSkipReason, esp_err_t> EspAsyncOta::checkVersion(const esp_app_desc_t &appDesc)
+{
+    const auto &policy = m_options.versionPolicy;
+    const esp_app_desc_t * const running = esp_app_get_description();
+
+    const auto newVersion = descField(appDesc.version, sizeof(appDesc.version));
+    const auto runningVersion = descField(running->version, sizeof(running->version));
+
+    if (policy.requireSameProject &&
+        descField(appDesc.project_name, sizeof(appDesc.project_name)) != descField(running->project_name, sizeof(running->project_name)))
+    {
+        ESP_LOGE(TAG, "image is for project %.*s", int(sizeof(appDesc.project_name)), appDesc.project_name);
+        return std::unexpected(failed("checkVersion", ESP_ERR_OTA_VALIDATE_FAILED));
+    }
+
+    if (std::equal(std::begin(appDesc.app_elf_sha256), std::end(appDesc.app_elf_sha256), std::begin(running->app_elf_sha256)))
+        return OtaSkipReason::SameImage;
+
+    if (!policy.allowSameVersion && newVersion == runningVersion)
+        return OtaSkipReason::SameVersion;
+
+    if (appDesc.secure_version < running->secure_version)
+        return OtaSkipReason::SecureVersion;
+
+    if (!policy.allowDowngrade)
+        if (const auto compared = compareVersions(newVersion, runningVersion); compared && *compared < 0)
+            return OtaSkipReason::Downgrade;
+
+    return OtaSkipReason::None;
+}
+
+esp_err_t EspAsyncOta::failed(const char *phase, esp_err_t error)
+{
+    m_error = OtaErrorRecord {
+        .phase = phase,
+        .error = error,
+        .httpStatus = m_transport ? m_transport->statusCode() : 0,
+        .offset = std::size_t(m_progress),
+        .timestamp = std::chrono::floor<std::chrono::milliseconds>(espchrono::millis_clock::now().time_since_epoch()),
+    };
+    return error;
+}
+
+void EspAsyncOta::applyPriority(OtaCloudUpdateStatus phase)
+{
+    std::lock_guard lock{m_priorityMutex};
+    if (const auto priority = priorityFor(m_priorities.load(), phase); uxTaskPriorityGet(NULL) != priority)
+        vTaskPrioritySet(NULL, priority);
+}
+
+esp_err_t EspAsyncOta::aborted()
+{
+    failed("abort", ESP_FAIL);
+    m_error.aborted = true;
+    return ESP_FAIL;
+}
+
+std::string EspAsyncOta::message() const
+{
+    if (status() == OtaCloudUpdateStatus::Skipped)
+        return std::format("skipped: {}", toString(m_skipReason));
+    return m_error.toString();
 }
 
 /*static*/ void EspAsyncOta::otaTask(void *arg)
@@ -289,10 +892,33 @@ void EspAsyncOta::otaTask()
 
     while (true)
     {
+        if (!startQueuedJob())
         {
-            const auto bits = m_eventGroup.waitBits(START_REQUEST_BIT, true, true, portMAX_DELAY);
+            const bool finished = m_eventGroup.getBits() & REQUEST_FINISHED_BIT;
+            const auto bits = m_eventGroup.waitBits(START_REQUEST_BIT, true, false,
+                                                    finished ? std::chrono::ceil<espcpputils::ticks>(FINISHED_LINGER).count() : portMAX_DELAY);
             if (!(bits & START_REQUEST_BIT))
+            {
+                {
+                    std::lock_guard lock{m_jobMutex};
+
+                    // enqueue() got a job in right at the deadline
+                    if (m_jobLoaded)
+                        continue;
+
+                    // also when a later queued job failed, an earlier one already switched the boot partition
+                    if (m_restartPending)
+                    {
+                        ESP_LOGI(TAG, "restarting into the new image");
+                        esp_restart();
+                    }
+
+                    m_eventGroup.clearBits(REQUEST_FINISHED_BIT | REQUEST_SUCCEEDED_BIT | REQUEST_SKIPPED_BIT);
+                }
+                m_appDesc = std::nullopt;
+                publishSnapshot(OtaCloudUpdateStatus::Idle);
                 continue;
+            }
         }
 
         {
@@ -305,164 +931,587 @@ void EspAsyncOta::otaTask()
         }
 
         m_progress = 0;
+        m_totalSize = std::nullopt;
+        m_error = {};
+        m_skipReason = OtaSkipReason::None;
+        m_rateEstimator.reset(0, timestamp());
 
+        applyPriority(OtaCloudUpdateStatus::Updating);
         m_eventGroup.setBits(REQUEST_RUNNING_BIT);
+        publishSnapshot(OtaCloudUpdateStatus::Updating);
 
         auto helper2 = cpputils::makeCleanupHelper([&](){
             m_eventGroup.clearBits(REQUEST_RUNNING_BIT | REQUEST_VERIFYING_BIT | ABORT_REQUEST_BIT);
             m_eventGroup.setBits(REQUEST_FINISHED_BIT);
+            applyPriority(OtaCloudUpdateStatus::Idle);
+
+            std::lock_guard lock{m_jobMutex};
+            m_jobLoaded = false;
         });
 
-        esp_http_client_config_t config{};
-        config.url = m_url.c_str();
-        if (!m_cert_pem.empty())
+        m_jobStats = {};
+        m_readLatency.reset();
+        m_writeLatency.reset();
+        const auto cpuStart = cpuTimestamp();
+
+        const auto result = performJob();
+
+        // complete before the job result is published, which is what waiters poll for
+        m_jobStats.bytes = m_progress;
+        if (const auto cpuEnd = cpuTimestamp(); cpuStart && cpuEnd)
+            m_jobStats.cpuTime = *cpuEnd - *cpuStart;
+
+        if (result == ESP_OK && m_skipReason != OtaSkipReason::None)
         {
-            config.cert_pem = m_cert_pem.data();
-            config.cert_len = m_cert_pem.size();
+            m_eventGroup.setBits(REQUEST_SKIPPED_BIT);
+            publishSnapshot(OtaCloudUpdateStatus::Skipped);
+            recordJobResult(OtaCloudUpdateStatus::Skipped);
         }
-        config.skip_cert_common_name_check = false;
-
-        if (m_use_global_ca)
+        else if (result == ESP_OK)
         {
-            //config.use_global_ca_store = true;
-            config.crt_bundle_attach = esp_crt_bundle_attach;
+            m_jobStats.succeeded = true;
+            if (m_sink->bootable())
+                m_restartPending = true;
+            m_eventGroup.setBits(REQUEST_SUCCEEDED_BIT);
+            publishSnapshot(OtaCloudUpdateStatus::Succeeded);
+            recordJobResult(OtaCloudUpdateStatus::Succeeded);
         }
-
-        if (!m_client_key.empty())
+        else
         {
-            config.client_key_pem = m_client_key.data();
-            config.client_key_len = m_client_key.size();
+            if (!m_error)
+                failed("perform", result);
+            char message[128];
+            m_error.format(message);
+            ESP_LOGE(TAG, "OTA failed: %s", message);
+            publishSnapshot(OtaCloudUpdateStatus::Failed);
+            recordJobResult(OtaCloudUpdateStatus::Failed);
         }
 
-        if (!m_client_cert.empty())
+        if (m_uploadTransport && m_transport == &*m_uploadTransport)
         {
-            config.client_cert_pem = m_client_cert.data();
-            config.client_cert_len = m_client_cert.size();
+            if (result != ESP_OK)
+                m_uploadTransport->respond("500 Internal Server Error", m_error.toString());
+            else if (m_skipReason != OtaSkipReason::None)
+                m_uploadTransport->respond("200 OK", std::format("skipped: {}", toString(m_skipReason)));
+            else
+                m_uploadTransport->respond("200 OK", "ok");
+            m_uploadTransport = std::nullopt;
         }
 
-        esp_https_ota_config_t ota_config = {
-            .http_config = &config,
-        };
+        ESP_LOGI(TAG, "OTA stats: %s", m_jobStats.toJson().c_str());
+
+        char histogram[160];
+        m_readLatency.format(histogram);
+        ESP_LOGI(TAG, "OTA read latency: %s", histogram);
+        m_writeLatency.format(histogram);
+        ESP_LOGI(TAG, "OTA write latency: %s", histogram);
+    }
+}
+
+esp_err_t EspAsyncOta::applyManifest()
+{
+    assert(m_mirrorTransport);
+
+    ESP_LOGI(TAG, "loading manifest...");
+    auto manifest = fetchOtaManifest(*m_manifestTransport);
+    if (!manifest)
+        return failed("manifest", manifest.error());
+
+    m_manifest = std::move(*manifest);
+    m_mirrorTransport->setMirrors(m_manifest->mirrors);
+
+    if (m_manifest->compression && m_options.compression == OtaCompression::Auto)
+        m_options.compression = *m_manifest->compression;
+    if (m_manifest->sha256 && !m_options.expectedSha256)
+        m_options.expectedSha256 = m_manifest->sha256;
+    // mirrors disagree on etags, the image hash identifies the image for all of them
+    if (m_options.imageId.empty())
+        m_options.imageId = m_manifest->sha256Hex;
+    if (m_manifest->size)
+        m_totalSize = *m_manifest->size;
+
+    return ESP_OK;
+}
+
+esp_err_t EspAsyncOta::performJob()
+{
+    assert(m_transport);
+    assert(m_sink);
 
-        esp_https_ota_handle_t https_ota_handle{};
+    m_manifest = std::nullopt;
+    if (m_manifestTransport)
+        if (const auto result = applyManifest(); result != ESP_OK)
+            return result;
 
-        ESP_LOGI(TAG, "esp_https_ota_begin()... (%s)", m_url.c_str());
+    std::optional<ParallelOtaTransport> parallel;
+    if (m_options.connections > 1 && m_httpCredentials)
+    {
+        std::vector<std::string> urls;
+        if (m_manifest)
+            urls = m_manifest->mirrors;
+        else
+            urls.push_back(m_httpTransport->url());
+
+        parallel.emplace(urls, m_options.connections, m_options.segmentSize,
+                         m_httpCredentials->cert_pem, m_httpCredentials->use_global_ca,
+                         m_httpCredentials->client_key, m_httpCredentials->client_cert,
+                         m_coreAffinity, m_stackSize);
+    }
 
+    MeteredOtaTransport metered{parallel ? static_cast<OtaTransport &>(*parallel) : *m_transport, m_readLatency};
+    DecompressingOtaTransport decompressed{metered, m_options.compression, m_staticDecompressInput};
+    std::optional<MeteredOtaTransport> fallbackMetered;
+    std::optional<DecompressingOtaTransport> fallbackDecompressed;
+    if (m_fallbackTransport)
+        fallbackDecompressed.emplace(fallbackMetered.emplace(*m_fallbackTransport, m_readLatency), m_options.compression);
+
+    std::optional<DeltaOtaTransport> delta;
+    if (m_options.delta)
+        delta.emplace(decompressed, fallbackDecompressed ? &*fallbackDecompressed : nullptr);
+
+    OtaTransport &transport = delta ? static_cast<OtaTransport &>(*delta) : decompressed;
+    OtaSink &sink = *m_sink;
+
+    const auto jobStart = timestamp();
+
+    std::optional<OtaSignatureVerifier> verifier;
+    if (m_signatureTransport)
+    {
+        ESP_LOGI(TAG, "loading signature...");
+        verifier.emplace();
+        if (const auto result = verifier->load(*m_signatureTransport, m_signaturePublicKey); result != ESP_OK)
+            return failed("signature", result);
+    }
+
+    auto transportHelper = cpputils::makeCleanupHelper([&](){ transport.close(); });
+
+    std::optional<std::size_t> imageSize;
+    int retries{};
+    auto backoff = m_options.retryBackoff;
+    const auto resume = [&](esp_err_t error, std::size_t offset) -> esp_err_t {
+        // compressed, delta and uploaded streams cannot continue mid-stream, keep their real error
+        if (offset && !transport.resumable())
+            return error;
+
+        while (isRetryable(error) && retries < m_options.maxRetries)
         {
-            const auto result = esp_https_ota_begin(&ota_config, &https_ota_handle);
-            ESP_LOG_LEVEL_LOCAL((result == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "esp_https_ota_begin() returned: %s", esp_err_to_name(result));
-            if (result != ESP_OK)
-            {
-                m_message = std::format("{}() failed with {} (at {})", "esp_https_ota_begin",
-                                        esp_err_to_name(result), std::chrono::floor<std::chrono::milliseconds>(espchrono::millis_clock::now().time_since_epoch()).count());
+            retries++;
+            m_jobStats.retries = retries;
+            ESP_LOGW(TAG, "transfer failed with %s at %zd, retry %i of %i in %lldms",
+                     esp_err_to_name(error), offset, retries, m_options.maxRetries, backoff.count());
+
+            transport.close();
+
+            // a pending abort is left set and handled by the perform loop
+            if (m_eventGroup.waitBits(ABORT_REQUEST_BIT, false, false, std::chrono::ceil<espcpputils::ticks>(backoff).count()) & ABORT_REQUEST_BIT)
+                return offset ? ESP_OK : error;
+
+            backoff = std::min<std::chrono::milliseconds>(backoff * 2, MAX_RETRY_BACKOFF);
+
+            error = transport.open(offset);
+            if (error != ESP_OK)
                 continue;
+
+            if (offset && transport.contentLength() != imageSize)
+            {
+                ESP_LOGE(TAG, "image size changed while resuming");
+                return ESP_ERR_INVALID_RESPONSE;
             }
+
+            return ESP_OK;
         }
 
-        if (https_ota_handle == NULL)
+        return error;
+    };
+
+    ESP_LOGI(TAG, "open()...");
+    {
+        auto result = transport.open(0);
+        if (result != ESP_OK)
+            result = resume(result, 0);
+        ESP_LOG_LEVEL_LOCAL((result == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "open() returned: %s", esp_err_to_name(result));
+        if (result != ESP_OK)
+        {
+            if (m_eventGroup.clearBits(ABORT_REQUEST_BIT) & ABORT_REQUEST_BIT)
+                return aborted();
+            return failed("open", result);
+        }
+    }
+
+    if (const auto timings = transport.connectTimings())
+    {
+        m_jobStats.connect = timings->connect;
+        m_jobStats.response = timings->response;
+    }
+
+    imageSize = transport.contentLength();
+
+    if (imageSize)
+    {
+        ESP_LOGI(TAG, "image size: %zd", *imageSize);
+        m_totalSize = *imageSize;
+        publishSnapshot(OtaCloudUpdateStatus::Updating);
+    }
+    else
+        ESP_LOGW(TAG, "image size unknown");
+
+    if (m_manifest && m_manifest->size && imageSize && *imageSize != *m_manifest->size)
+    {
+        ESP_LOGE(TAG, "image size %zd does not match manifest size %zd", *imageSize, *m_manifest->size);
+        return failed("manifest", ESP_ERR_INVALID_SIZE);
+    }
+
+    if (verifier && imageSize && *imageSize != verifier->imageSize())
+    {
+        ESP_LOGE(TAG, "image size %zd does not match signed size %zd", *imageSize, verifier->imageSize());
+        return failed("signature", ESP_ERR_INVALID_SIZE);
+    }
+
+    std::size_t offset{};
+    std::optional<OtaCheckpoint> checkpoint;
+    const auto checkpointName = sink.partition() ? std::optional{checkpointKey(*sink.partition())} : std::nullopt;
+    if (const auto identity = !m_options.imageId.empty() ? m_options.imageId : transport.etag();
+        m_options.checkpointInterval.count() > 0 && imageSize && !identity.empty() && sink.partition() && transport.resumable())
+    {
+        checkpoint = OtaCheckpoint {
+            .partitionAddress = sink.partition()->address,
+            .imageSize = uint32_t(*imageSize),
+            .identity = otaImageIdentity(identity),
+            .committed = 0
+        };
+
+        if (const auto saved = loadOtaCheckpoint(checkpointName->data());
+            saved && saved->partitionAddress == checkpoint->partitionAddress && saved->imageSize == checkpoint->imageSize &&
+            saved->identity == checkpoint->identity && saved->committed < checkpoint->imageSize)
         {
-            ESP_LOGE(TAG, "ota handle invalid");
-            m_message = std::format("ota handle invalid (at {})",
-                                    std::chrono::floor<std::chrono::milliseconds>(espchrono::millis_clock::now().time_since_epoch()).count());
-            continue;
+            ESP_LOGI(TAG, "resuming from checkpoint at %lu", saved->committed);
+            offset = saved->committed;
+            if (const auto result = transport.open(offset); result != ESP_OK || transport.contentLength() != imageSize)
+            {
+                ESP_LOGW(TAG, "resuming failed, starting from the beginning");
+                offset = 0;
+                if (const auto result = transport.open(0); result != ESP_OK)
+                    return failed("open", result);
+            }
+            checkpoint->committed = offset;
         }
+    }
+
+    const auto dropCheckpoint = [&](){
+        if (checkpoint)
+            clearOtaCheckpoint(checkpointName->data());
+    };
+
+    // a fresh start overwrites whatever an older checkpoint of this partition vouches for
+    if (!offset && checkpointName)
+        clearOtaCheckpoint(checkpointName->data());
+
+    ESP_LOGI(TAG, "begin()...");
+    {
+        const auto result = sink.begin(imageSize, offset);
+        ESP_LOG_LEVEL_LOCAL((result == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "begin() returned: %s", esp_err_to_name(result));
+        if (result != ESP_OK)
+            return failed("begin", result);
+    }
+
+    m_jobStats.begin = timestamp() - jobStart;
+    auto phaseStart = timestamp();
+
+    bool sinkFinished{};
+    auto sinkHelper = cpputils::makeCleanupHelper([&](){
+        if (!sinkFinished)
+            sink.abort();
+    });
+
+    OtaBlockPipeline pipeline{sink, m_pipelineBlockCount, m_pipelineBlockSize, m_writerCoreAffinity.value_or(m_coreAffinity),
+                              4096, m_staticPipeline ? &*m_staticPipeline : nullptr};
+    if (const auto result = pipeline.start(); result != ESP_OK)
+        return failed("start", result);
+
+    std::array<uint8_t, IMAGE_HEADER_SIZE> header;
+    m_appDesc = std::nullopt;
+    m_progress = offset;
+    m_rateEstimator.reset(offset, timestamp());
+
+    // data partitions carry no appended digest, whatever their first bytes look like
+    OtaImageHasher hasher{sink.bootable()};
+    m_imageSha256 = std::nullopt;
+
+    if (offset)
+    {
+        esp_app_desc_t appDesc;
+        if (sink.bootable() && esp_ota_get_partition_description(sink.partition(), &appDesc) == ESP_OK)
+            m_appDesc = appDesc;
 
+        // the streamed digest has to cover the part written before the resume
+        std::array<uint8_t, 512> chunk;
+        for (std::size_t pos = 0; pos < offset; pos += chunk.size())
         {
-            ESP_LOGI(TAG, "esp_https_ota_get_img_desc()...");
-            esp_app_desc_t new_app_info;
-            const auto result = esp_https_ota_get_img_desc(https_ota_handle, &new_app_info);
-            ESP_LOG_LEVEL_LOCAL((result == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "esp_https_ota_get_img_desc() returned: %s", esp_err_to_name(result));
-            if (result == ESP_OK)
-                m_appDesc = new_app_info;
-            else
-                m_appDesc = std::nullopt;
+            const auto size = std::min(chunk.size(), offset - pos);
+            if (const auto result = esp_partition_read(sink.partition(), pos, chunk.data(), size); result != ESP_OK)
+                return failed("esp_partition_read", result);
+            hasher.update({chunk.data(), size});
+            if (verifier)
+                if (const auto result = verifier->update({chunk.data(), size}); result != ESP_OK)
+                {
+                    dropCheckpoint();
+                    return failed("signature", result);
+                }
         }
+    }
+
+    const auto inspect = [&](std::span<const uint8_t> data) -> esp_err_t {
+        hasher.update(data);
+
+        // a chunk is only verified once its last byte arrived, earlier blocks of a
+        // bad chunk may already be written; the sink is aborted, never committed
+        if (verifier)
+            if (const auto result = verifier->update(data); result != ESP_OK)
+                return result;
 
-        ESP_LOGI(TAG, "esp_https_ota_get_image_size()...");
+        if (!sink.bootable() || m_appDesc || std::size_t(m_progress) >= header.size())
+            return ESP_OK;
+
+        const auto count = std::min(header.size() - m_progress, data.size());
+        std::copy_n(std::begin(data), count, std::begin(header) + m_progress);
+        if (m_progress + count == header.size())
         {
-            const auto size = esp_https_ota_get_image_size(https_ota_handle);
-            ESP_LOG_LEVEL_LOCAL((size > 0 ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "esp_https_ota_get_image_size() returned: %i", size);
-            if (size > 0)
-                m_totalSize = size;
+            m_appDesc = parseAppDesc(header);
+            m_jobStats.imgDesc = timestamp() - phaseStart;
+            phaseStart = timestamp();
         }
 
-        ESP_LOGI(TAG, "esp_https_ota_perform()...");
-        bool aborted{};
-        esp_err_t ota_perform_err;
+        return ESP_OK;
+    };
+
+    ESP_LOGI(TAG, "perform()... (%s)", pipeline.pipelined() ? "pipelined" : "single stage");
+    {
+        espchrono::millis_clock::time_point lastCheckpoint = espchrono::millis_clock::now();
+        // cpu time of the ota task with run time stats, otherwise wall time minus
+        // the time spent waiting for the network and for free blocks
+        std::chrono::microseconds writerWait{};
+        const auto busyClock = [&]{
+            if (const auto cpu = cpuTimestamp())
+                return *cpu;
+            return timestamp() - metered.waited() - (fallbackMetered ? fallbackMetered->waited() : 0us) - writerWait;
+        };
+        auto busySince = busyClock();
+        // a pending abort ends the sleep early and is handled at the top of the loop
+        const auto rest = [&](std::chrono::microseconds duration){
+            const auto start = timestamp();
+            m_eventGroup.waitBits(ABORT_REQUEST_BIT, false, false, std::max<TickType_t>(std::chrono::ceil<espcpputils::ticks>(duration).count(), 1));
+            m_jobStats.throttled += timestamp() - start;
+            busySince = busyClock();
+            // keeps the rate decaying and the snapshot current while nothing arrives
+            publishSnapshot(OtaCloudUpdateStatus::Updating);
+        };
+        OtaTokenBucket bucket;
+        bucket.configure(m_rateLimit.load(), timestamp());
+        std::size_t charged{};
+        OtaBlockPipeline::Block *block{};
+        bool eof{};
+        // a resumed image already passed the check, data partitions have no version
+        bool versionChecked = !m_options.versionPolicy.enabled || offset || !sink.bootable();
+        while (!eof)
         {
-            espchrono::millis_clock::time_point lastYield = espchrono::millis_clock::now();
-            while (true)
+            if (m_eventGroup.clearBits(ABORT_REQUEST_BIT) & ABORT_REQUEST_BIT)
             {
-                ota_perform_err = esp_https_ota_perform(https_ota_handle);
-                if (ota_perform_err != ESP_ERR_HTTPS_OTA_IN_PROGRESS)
-                    break;
+                ESP_LOGW(TAG, "abort request received");
+                dropCheckpoint();
+                return aborted();
+            }
 
-                m_progress = esp_https_ota_get_image_len_read(https_ota_handle);
-                if (espchrono::ago(lastYield) >= 1s)
+            if (checkpoint && espchrono::ago(lastCheckpoint) >= m_options.checkpointInterval)
+            {
+                lastCheckpoint = espchrono::millis_clock::now();
+                if (const uint32_t committed = (offset + pipeline.committed()) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+                    committed > checkpoint->committed)
                 {
-                    lastYield = espchrono::millis_clock::now();
-                    vPortYield();
+                    checkpoint->committed = committed;
+                    saveOtaCheckpoint(checkpointName->data(), *checkpoint);
                 }
+            }
+
+            if (!block)
+            {
+                const auto waitStart = timestamp();
+                auto acquired = pipeline.acquire();
+                writerWait += timestamp() - waitStart;
+                if (!acquired)
+                    return failed("write", acquired.error());
+                block = *acquired;
+            }
+
+            const auto read = transport.read({block->data + block->size, pipeline.blockSize() - block->size});
 
-                if (m_eventGroup.clearBits(ABORT_REQUEST_BIT) & ABORT_REQUEST_BIT)
+            // charged with what came off the network, inflated and locally copied delta bytes are free
+            if (const auto received = metered.received() + (fallbackMetered ? fallbackMetered->received() : 0); received != charged)
+            {
+                if (const auto limit = m_rateLimit.load();
+                    limit.bytesPerSecond != bucket.limit().bytesPerSecond || limit.burst != bucket.limit().burst)
+                    bucket.configure(limit, timestamp());
+                if (const auto wait = bucket.consume(received - charged, timestamp()); wait.count() > 0)
+                    rest(wait);
+                charged = received;
+            }
+            if (!read)
+            {
+                if (read.error() != ESP_ERR_HTTP_EAGAIN)
                 {
-                    ESP_LOGW(TAG, "abort request received");
-                    aborted = true;
-                    m_message = "Requested abort";
-                    ota_perform_err = ESP_FAIL;
-                    break;
+                    ESP_LOGE(TAG, "read() failed with %s", esp_err_to_name(read.error()));
+                    if (const auto result = resume(read.error(), m_progress); result != ESP_OK)
+                        return failed("read", result);
+                }
+                publishSnapshot(OtaCloudUpdateStatus::Updating);
+                continue;
+            }
+
+            if (*read == 0)
+                eof = true;
+            else
+            {
+                if (!m_jobStats.firstByte)
+                    m_jobStats.firstByte = timestamp() - jobStart;
+
+                if (const auto result = inspect({block->data + block->size, *read}); result != ESP_OK)
+                {
+                    ESP_LOGE(TAG, "rejecting image at %i", m_progress);
+                    dropCheckpoint();
+                    return failed("signature", result);
+                }
+
+                // the first block is still unsubmitted here, so a skip costs no flash erase
+                if (!versionChecked && m_appDesc)
+                {
+                    versionChecked = true;
+                    if (const auto result = checkVersion(*m_appDesc); !result)
+                    {
+                        dropCheckpoint();
+                        return result.error();
+                    }
+                    else if (*result != OtaSkipReason::None)
+                    {
+                        ESP_LOGI(TAG, "skipping update: %s", toString(*result).c_str());
+                        m_skipReason = *result;
+                        dropCheckpoint();
+                        return ESP_OK;
+                    }
+                }
+                block->size += *read;
+                m_progress += *read;
+                publishSnapshot(OtaCloudUpdateStatus::Updating);
+            }
+
+            const auto policy = m_yieldPolicy.load();
+
+            if (eof || block->size == pipeline.blockSize())
+            {
+                if (!block->size)
+                    pipeline.release(block);
+                else
+                {
+                    const auto waitStart = timestamp();
+                    const auto result = pipeline.submit(block);
+                    writerWait += timestamp() - waitStart;
+                    if (result != ESP_OK)
+                        return failed("write", result);
+                }
+                block = nullptr;
+
+                if (!eof && policy.sleepBetweenChunks.count() > 0)
+                    rest(policy.sleepBetweenChunks);
+            }
+
+            if (const auto busy = busyClock() - busySince; busy >= policy.maxBusy)
+            {
+                if (policy.cpuShare > 0.f && policy.cpuShare < 1.f)
+                    rest(std::chrono::duration_cast<std::chrono::microseconds>(busy * ((1.f - policy.cpuShare) / policy.cpuShare)));
+                else
+                {
+                    vPortYield();
+                    busySince = busyClock();
                 }
             }
         }
-        ESP_LOG_LEVEL_LOCAL((ota_perform_err == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "esp_https_ota_perform() returned: %s", esp_err_to_name(ota_perform_err));
 
-        if (ota_perform_err == ESP_OK)
-            m_eventGroup.setBits(REQUEST_VERIFYING_BIT);
+        const auto drained = pipeline.drain();
+        m_writeLatency = pipeline.writeLatency();
+        if (drained != ESP_OK)
+            return failed("write", drained);
+    }
+    m_jobStats.perform = timestamp() - phaseStart;
+    ESP_LOGI(TAG, "perform() finished after %i bytes", m_progress);
 
+    applyPriority(OtaCloudUpdateStatus::Verifying);
 
-#if defined(CONFIG_ESP_TASK_WDT_PANIC) || defined(CONFIG_ESP_TASK_WDT)
-        const auto taskHandle = xTaskGetCurrentTaskHandle();
-        if (taskHandle)
+    if (const auto size = transport.contentLength(); size && *size != std::size_t(m_progress))
+    {
+        ESP_LOGE(TAG, "received %i of %zd bytes", m_progress, *size);
+        return failed("perform", ESP_ERR_INVALID_SIZE);
+    }
+
+    {
+        const auto hash = hasher.finish();
+        m_imageSha256 = hash.digest;
+
+        if (hash.appendedDigestMatches == false)
         {
-            if (const auto result = esp_task_wdt_add(taskHandle); result != ESP_OK)
-                ESP_LOGE(TAG, "esp_task_wdt_add() failed with %s", esp_err_to_name(result));
+            ESP_LOGE(TAG, "image does not match its appended sha256");
+            dropCheckpoint();
+            return failed("verify", ESP_ERR_OTA_VALIDATE_FAILED);
         }
-        else
-            ESP_LOGE(TAG, "could not get handle to current ota task!");
-#endif
 
-        ESP_LOGI(TAG, "esp_https_ota_finish()...");
-        const auto ota_finish_err = esp_https_ota_finish(https_ota_handle);
-        ESP_LOG_LEVEL_LOCAL((ota_finish_err == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "esp_https_ota_finish() returned: %s", esp_err_to_name(ota_finish_err));
-
-#if defined(CONFIG_ESP_TASK_WDT_PANIC) || defined(CONFIG_ESP_TASK_WDT)
-        if (taskHandle)
+        if (m_options.expectedSha256 && *m_options.expectedSha256 != hash.digest)
         {
-            if (const auto result = esp_task_wdt_reset(); result != ESP_OK)
-                ESP_LOGE(TAG, "esp_task_wdt_reset() failed with %s", esp_err_to_name(result));
-            if (const auto result = esp_task_wdt_delete(taskHandle); result != ESP_OK)
-                ESP_LOGE(TAG, "esp_task_wdt_delete() failed with %s", esp_err_to_name(result));
+            ESP_LOGE(TAG, "image does not match the expected sha256");
+            dropCheckpoint();
+            return failed("verify", ESP_ERR_OTA_VALIDATE_FAILED);
         }
-#endif
+    }
 
-        if (!aborted)
+    if (verifier)
+    {
+        if (const auto result = verifier->finish(); result != ESP_OK)
         {
-            if (ota_perform_err != ESP_OK)
-                m_message = std::format("{}() failed with {} (at {})",
-                                        "esp_https_ota_perform",
-                                        esp_err_to_name(ota_perform_err),
-                                        std::chrono::floor<std::chrono::milliseconds>(espchrono::millis_clock::now().time_since_epoch()).count());
-            else if (ota_finish_err != ESP_OK)
-                m_message = std::format("{}() failed with {} (at {})",
-                                        "esp_https_ota_finish",
-                                        esp_err_to_name(ota_finish_err),
-                                        std::chrono::floor<std::chrono::milliseconds>(espchrono::millis_clock::now().time_since_epoch()).count());
-            else
-                m_message.clear();
+            dropCheckpoint();
+            return failed("signature", result);
         }
+    }
 
-        if (ota_perform_err == ESP_OK &&
-            ota_finish_err == ESP_OK)
-            m_eventGroup.setBits(REQUEST_SUCCEEDED_BIT);
+    m_eventGroup.setBits(REQUEST_VERIFYING_BIT);
+    publishSnapshot(OtaCloudUpdateStatus::Verifying);
+
+#if defined(CONFIG_ESP_TASK_WDT_PANIC) || defined(CONFIG_ESP_TASK_WDT)
+    const auto taskHandle = xTaskGetCurrentTaskHandle();
+    if (taskHandle)
+    {
+        if (const auto result = esp_task_wdt_add(taskHandle); result != ESP_OK)
+            ESP_LOGE(TAG, "esp_task_wdt_add() failed with %s", esp_err_to_name(result));
+    }
+    else
+        ESP_LOGE(TAG, "could not get handle to current ota task!");
+#endif
+
+    ESP_LOGI(TAG, "finish()...");
+    sinkFinished = true;
+    phaseStart = timestamp();
+    const auto finishResult = sink.finish();
+    dropCheckpoint();
+    m_jobStats.finish = timestamp() - phaseStart;
+    ESP_LOG_LEVEL_LOCAL((finishResult == ESP_OK ? ESP_LOG_INFO : ESP_LOG_ERROR), TAG, "finish() returned: %s", esp_err_to_name(finishResult));
+
+#if defined(CONFIG_ESP_TASK_WDT_PANIC) || defined(CONFIG_ESP_TASK_WDT)
+    if (taskHandle)
+    {
+        if (const auto result = esp_task_wdt_reset(); result != ESP_OK)
+            ESP_LOGE(TAG, "esp_task_wdt_reset() failed with %s", esp_err_to_name(result));
+        if (const auto result = esp_task_wdt_delete(taskHandle); result != ESP_OK)
+            ESP_LOGE(TAG, "esp_task_wdt_delete() failed with %s", esp_err_to_name(result));
     }
+#endif
+
+    if (finishResult != ESP_OK)
+        return failed("finish", finishResult);
+
+    return ESP_OK;
 }
@@ -1,18 +1,42 @@
 #pragma once
 
 // system includes
+#include <array>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <expected>
 
 // esp-idf includes
 #include <esp_app_desc.h>
+#include <esp_event.h>
 
 // local includes
 #include "taskutils.h"
 #include "wrappers/event_group.h"
 #include "espchrono.h"
 #include "cpptypesafeenum.h"
+#include "otatransport.h"
+#include "otasink.h"
+#include "httpotatransport.h"
+#include "httpdotatransport.h"
+#include "apppartitionotasink.h"
+#include "partitionotasink.h"
+#include "otajobstats.h"
+#include "otaerrorrecord.h"
+#include "otablockpipeline.h"
+#include "decompressingotatransport.h"
+#include "deltaotatransport.h"
+#include "otaseqlock.h"
+#include "otarateestimator.h"
+#include "otaimagehasher.h"
+#include "otasignatureverifier.h"
+#include "otamanifest.h"
+#include "meteredotatransport.h"
+#include "mirroredotatransport.h"
+#include "parallelotatransport.h"
+#include "otastaticstorage.h"
+#include "otatokenbucket.h"
 
 #define OtaCloudUpdateStatusValues(x) \
     x(Idle) \
@@ -20,9 +44,112 @@
     x(Failed) \
     x(Succeeded) \
     x(NotReady) \
-    x(Verifying)
+    x(Verifying) \
+    x(Skipped)
 DECLARE_TYPESAFE_ENUM(OtaCloudUpdateStatus, : uint8_t, OtaCloudUpdateStatusValues)
 
+#define OtaSkipReasonValues(x) \
+    x(None) \
+    x(SameImage) \
+    x(SameVersion) \
+    x(Downgrade) \
+    x(SecureVersion)
+DECLARE_TYPESAFE_ENUM(OtaSkipReason, : uint8_t, OtaSkipReasonValues)
+
+struct OtaProgressSnapshot
+{
+    OtaCloudUpdateStatus phase{OtaCloudUpdateStatus::Idle};
+    std::size_t bytesRead{};
+    std::optional<std::size_t> totalSize;
+    float rate{};
+    float instantRate{};
+    std::optional<std::chrono::milliseconds> eta;
+    esp_err_t errorCode{ESP_OK};
+};
+
+// Events are posted with an OtaProgressSnapshot as event data, except
+// ESPASYNCOTA_EVENT_JOB_FINISHED which carries an OtaJobResult
+ESP_EVENT_DECLARE_BASE(ESPASYNCOTA_EVENTS);
+
+enum : int32_t
+{
+    ESPASYNCOTA_EVENT_PHASE,
+    ESPASYNCOTA_EVENT_PROGRESS,
+    ESPASYNCOTA_EVENT_JOB_FINISHED,
+};
+
+struct OtaEventConfig
+{
+    bool enabled{};
+    esp_event_loop_handle_t loop{}; // default event loop if null
+    std::size_t everyBytes{};
+    std::chrono::milliseconds everyInterval{};
+};
+
+// Compared against the running app as soon as the incoming app descriptor is
+// known, before anything is written to flash. Rejected images end the job with
+// OtaCloudUpdateStatus::Skipped instead of Failed.
+struct OtaVersionPolicy
+{
+    bool enabled{};
+    bool allowSameVersion{};   // same version string but a different build
+    bool allowDowngrade{true}; // dotted numeric versions only
+    bool requireSameProject{true};
+};
+
+// How the perform loop gives the cpu away. After maxBusy of cpu time it
+// yields, or with cpuShare < 1 sleeps long enough to keep its share of the
+// wall time at cpuShare. Cpu time comes from the run time stats when enabled,
+// otherwise it is approximated by leaving out the waits for the network and
+// the writer. sleepBetweenChunks additionally sleeps after every block handed
+// to the writer.
+struct OtaYieldPolicy
+{
+    std::chrono::milliseconds maxBusy{1000};
+    std::chrono::milliseconds sleepBetweenChunks{};
+    float cpuShare{1.f};
+};
+
+// Priority of the ota task per phase. The writer and fetch tasks inherit the
+// download priority when they are created.
+struct OtaTaskPriorities
+{
+    UBaseType_t idle{10};
+    UBaseType_t download{10};
+    UBaseType_t finish{10}; // verification and committing the image
+};
+
+struct OtaTriggerOptions
+{
+    OtaCompression compression{OtaCompression::Auto};
+    bool delta{};
+    std::string_view fallbackUrl;
+    int maxRetries{3};
+    std::chrono::milliseconds retryBackoff{1000};
+    std::chrono::milliseconds checkpointInterval{};
+    std::string_view imageId;
+    std::optional<OtaSha256> expectedSha256;
+    std::string_view signatureUrl;
+    std::string_view signaturePublicKey;
+    OtaVersionPolicy versionPolicy;
+    // url and manifest triggers only, 1 keeps the single stream
+    std::size_t connections{1};
+    std::size_t segmentSize{32768};
+    // url, manifest and upload triggers only, writes to this partition instead of the
+    // next app slot; data partitions skip the app header and the restart
+    std::string_view partitionLabel;
+    std::optional<esp_partition_subtype_t> dataSubtype;
+};
+
+// Outcome of a job started through enqueue(), kept after the next job started
+struct OtaJobResult
+{
+    uint32_t id{};
+    OtaCloudUpdateStatus status{OtaCloudUpdateStatus::Idle}; // Succeeded, Failed or Skipped
+    OtaSkipReason skipReason{OtaSkipReason::None};
+    OtaErrorRecord error;
+};
+
 class EspAsyncOta
 {
 public:
@@ -35,18 +162,96 @@ public:
     int progress() const { return m_progress; }
     std::optional<int> totalSize() const { return m_totalSize; }
     void setTotalSize(int totalSize) { m_totalSize = totalSize; }
-    const std::string &message() const { return m_message; }
+    float rate() const { return snapshot().rate; }
+    float instantRate() const { return snapshot().instantRate; }
+    std::optional<std::chrono::milliseconds> eta() const { return snapshot().eta; }
+    std::string message() const;
+    const OtaErrorRecord &lastError() const { return m_error; }
     const std::optional<esp_app_desc_t> &appDesc() const { return m_appDesc; }
+    const std::optional<OtaSha256> &imageSha256() const { return m_imageSha256; }
+    OtaSkipReason skipReason() const { return m_skipReason; }
+    const std::optional<OtaManifest> &manifest() const { return m_manifest; }
     OtaCloudUpdateStatus status() const;
+    // consistent view of the running job, safe to poll from any task or core
+    OtaProgressSnapshot snapshot() const { return m_snapshot.load(); }
+    const OtaJobStats &jobStats() const { return m_jobStats; }
+    const OtaLatencyHistogram &readLatency() const { return m_readLatency; }
+    const OtaLatencyHistogram &writeLatency() const { return m_writeLatency; }
     std::expected<void, std::string> trigger(std::string_view url, std::string_view cert_pem, bool use_global_ca,
-                                             std::string_view client_key, std::string_view client_cert);
+                                             std::string_view client_key, std::string_view client_cert,
+                                             const OtaTriggerOptions &options = {});
+    std::expected<void, std::string> trigger(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options = {},
+                                             OtaTransport *fallbackTransport = nullptr, OtaTransport *signatureTransport = nullptr);
+    // fetches an OtaManifest from manifestUrl and downloads from the fastest of its mirrors
+    std::expected<void, std::string> triggerManifest(std::string_view manifestUrl, std::string_view cert_pem, bool use_global_ca,
+                                                     std::string_view client_key, std::string_view client_cert,
+                                                     const OtaTriggerOptions &options = {});
+    // Call from a POST handler and return from it right away. The body is
+    // streamed into the target partition on the ota task, which answers the
+    // request once the job ended.
+    std::expected<void, std::string> triggerUpload(httpd_req_t *req, const OtaTriggerOptions &options = {});
+    // Runs the job right away when idle, otherwise queues it behind the running
+    // one, higher priority first. Queued jobs run one after another on the same
+    // task and buffers. Transports, sink and the strings referenced by options
+    // have to outlive the job. Returns an id for jobResult().
+    std::expected<uint32_t, std::string> enqueue(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options = {},
+                                             int priority = 0, OtaTransport *fallbackTransport = nullptr,
+                                             OtaTransport *signatureTransport = nullptr);
+    std::size_t queuedJobs() const;
+    void clearQueue();
+    // results of the last few enqueued jobs, nullopt while pending or when forgotten
+    std::optional<OtaJobResult> jobResult(uint32_t id) const;
     std::expected<void, std::string> abort();
 
+    void setEventConfig(const OtaEventConfig &config) { m_eventConfig = config; }
+    // takes effect immediately, also while a job is running
+    void setYieldPolicy(const OtaYieldPolicy &policy) { m_yieldPolicy.store(policy); }
+    OtaYieldPolicy yieldPolicy() const { return m_yieldPolicy.load(); }
+    // takes effect immediately, also while a job is running
+    void setPriorities(const OtaTaskPriorities &priorities);
+    OtaTaskPriorities priorities() const { return m_priorities.load(); }
+    // takes effect immediately, also while a job is running
+    void setRateLimit(const OtaRateLimit &limit) { m_rateLimit.store(limit); }
+    OtaRateLimit rateLimit() const { return m_rateLimit.load(); }
+    void setPipeline(std::size_t blockCount, std::size_t blockSize, std::optional<espcpputils::CoreAffinity> writerCoreAffinity = std::nullopt);
+
+    // runs the task and pipeline from caller owned memory, call before startTask()
+    void setStaticStorage(OtaStaticTaskStorage task, const OtaBlockPipeline::Storage &pipeline, std::size_t blockCount, std::size_t blockSize,
+                          std::span<uint8_t> decompressInput = {});
+    template<uint32_t TaskStackSize, std::size_t BlockCount, std::size_t BlockSize, uint32_t WriterStackSize>
+    void setStaticStorage(OtaStaticStorage<TaskStackSize, BlockCount, BlockSize, WriterStackSize> &storage)
+    {
+        setStaticStorage(storage.taskStorage(), storage.pipelineStorage(), BlockCount, BlockSize, storage.decompressInput);
+    }
+
+    // logs progress, jobs finish and the restart happens in the ota task without it
     void update();
 
 private:
     static void otaTask(void *arg);
     void otaTask();
+    // ensureIdle(), startJob() and loadJob() with m_jobMutex held
+    std::expected<void, std::string> ensureIdle();
+    std::expected<OtaSink *, std::string> prepareSink(const OtaTriggerOptions &options);
+    std::expected<OtaSink *, std::string> prepareHttpJob(std::string_view cert_pem, bool use_global_ca,
+                                                         std::string_view client_key, std::string_view client_cert,
+                                                         const OtaTriggerOptions &options);
+    std::expected<void, std::string> startJob(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                                              OtaTransport *fallbackTransport, OtaTransport *signatureTransport,
+                                              OtaTransport *manifestTransport, uint32_t jobId = 0);
+    esp_err_t applyManifest();
+    void loadJob(OtaTransport &transport, OtaSink &sink, const OtaTriggerOptions &options,
+                 OtaTransport *fallbackTransport, OtaTransport *signatureTransport,
+                 OtaTransport *manifestTransport, uint32_t jobId);
+    bool startQueuedJob();
+    void recordJobResult(OtaCloudUpdateStatus status);
+    esp_err_t performJob();
+    void publishSnapshot(OtaCloudUpdateStatus phase);
+    void postEvents(const OtaProgressSnapshot &snapshot);
+    std::expected<OtaSkipReason, esp_err_t> checkVersion(const esp_app_desc_t &appDesc);
+    esp_err_t failed(const char *phase, esp_err_t error);
+    esp_err_t aborted();
+    void applyPriority(OtaCloudUpdateStatus phase);
 
     const char * const m_taskName;
     const uint32_t m_stackSize;
@@ -54,8 +259,27 @@ private:
 
     int m_progress{};
     std::optional<int> m_totalSize;
-    std::string m_message;
     std::optional<esp_app_desc_t> m_appDesc;
+    std::optional<OtaSha256> m_imageSha256;
+    OtaSkipReason m_skipReason{OtaSkipReason::None};
+    OtaJobStats m_jobStats;
+    OtaLatencyHistogram m_readLatency;
+    OtaLatencyHistogram m_writeLatency;
+
+    OtaErrorRecord m_error;
+    OtaRateEstimator m_rateEstimator;
+    OtaSeqlock<OtaProgressSnapshot> m_snapshot;
+    OtaSeqlock<OtaYieldPolicy> m_yieldPolicy;
+    OtaSeqlock<OtaRateLimit> m_rateLimit;
+    OtaSeqlock<OtaTaskPriorities> m_priorities;
+    std::mutex m_priorityMutex;
+
+    OtaEventConfig m_eventConfig;
+    std::optional<OtaCloudUpdateStatus> m_lastEventPhase;
+    std::size_t m_lastEventBytes{};
+    std::chrono::microseconds m_lastEventTs{};
+    bool m_phaseEventPending{};
+    bool m_progressEventPending{};
 
     espcpputils::event_group m_eventGroup;
     TaskHandle_t m_taskHandle{};
@@ -63,10 +287,59 @@ private:
     std::optional<espchrono::millis_clock::time_point> m_finishedTs;
     std::optional<espchrono::millis_clock::time_point> m_lastInfo;
 
-    std::string m_url;
-    std::string_view m_cert_pem;
-    bool m_use_global_ca;
-    std::string_view m_client_key;
-    std::string_view m_client_cert;
+    std::optional<HttpOtaTransport> m_httpTransport;
+    std::optional<HttpOtaTransport> m_fallbackHttpTransport;
+    std::optional<HttpOtaTransport> m_signatureHttpTransport;
+    std::optional<HttpOtaTransport> m_manifestHttpTransport;
+    std::optional<MirroredOtaTransport> m_mirrorTransport;
+    struct HttpCredentials
+    {
+        std::string_view cert_pem;
+        bool use_global_ca;
+        std::string_view client_key;
+        std::string_view client_cert;
+    };
+    std::optional<HttpCredentials> m_httpCredentials;
+    std::optional<AppPartitionOtaSink> m_appSink;
+    std::optional<PartitionOtaSink> m_partitionSink;
+    std::optional<HttpdOtaTransport> m_uploadTransport;
+    OtaTransport *m_transport{};
+    OtaTransport *m_fallbackTransport{};
+    OtaTransport *m_signatureTransport{};
+    OtaTransport *m_manifestTransport{};
+    std::optional<OtaManifest> m_manifest;
+    std::string m_signaturePublicKey;
+    OtaSink *m_sink{};
+    OtaTriggerOptions m_options;
+
+    std::size_t m_pipelineBlockCount{4};
+    std::size_t m_pipelineBlockSize{4096};
+    std::optional<espcpputils::CoreAffinity> m_writerCoreAffinity;
+
+    struct QueuedJob
+    {
+        OtaTransport *transport;
+        OtaSink *sink;
+        OtaTriggerOptions options;
+        OtaTransport *fallbackTransport;
+        OtaTransport *signatureTransport;
+        int priority;
+        uint32_t id;
+    };
+    static constexpr std::size_t MAX_QUEUED_JOBS = 4;
+    // guards the queue and hands jobs to the ota task
+    mutable std::mutex m_jobMutex;
+    bool m_jobLoaded{}; // from loadJob() until the ota task finished the job
+    std::array<QueuedJob, MAX_QUEUED_JOBS> m_queue;
+    std::size_t m_queueSize{};
+    uint32_t m_lastJobId{};
+    uint32_t m_jobId{}; // 0 for jobs not started through enqueue()
+    std::array<OtaJobResult, MAX_QUEUED_JOBS> m_jobResults;
+    std::size_t m_nextJobResult{};
+    bool m_restartPending{};
+
+    std::optional<OtaStaticTaskStorage> m_staticTask;
+    std::optional<OtaBlockPipeline::Storage> m_staticPipeline;
+    std::span<uint8_t> m_staticDecompressInput;
 };
 
@@ -0,0 +1,92 @@
+#include "httpdotatransport.h"
+
+// system includes
+#include <algorithm>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_http_client.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+// consecutive receive timeouts of the server (recv_wait_timeout each) before the upload counts as stalled
+constexpr int MAX_TIMEOUTS = 3;
+} // namespace
+
+HttpdOtaTransport::HttpdOtaTransport(httpd_req_t *req) :
+    m_req{req},
+    m_contentLength{req->content_len}
+{
+    if (const auto length = httpd_req_get_hdr_value_len(m_req, "Content-Encoding"))
+    {
+        m_contentEncoding.resize(length + 1);
+        if (httpd_req_get_hdr_value_str(m_req, "Content-Encoding", m_contentEncoding.data(), m_contentEncoding.size()) == ESP_OK)
+            m_contentEncoding.resize(length);
+        else
+            m_contentEncoding.clear();
+    }
+}
+
+HttpdOtaTransport::~HttpdOtaTransport()
+{
+    if (m_req)
+        httpd_req_async_handler_complete(m_req);
+}
+
+esp_err_t HttpdOtaTransport::open(std::size_t offset)
+{
+    if (m_opened || offset)
+    {
+        ESP_LOGE(TAG, "an uploaded body cannot be read again");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    m_opened = true;
+    m_remaining = m_contentLength;
+    m_timeouts = 0;
+
+    ESP_LOGI(TAG, "receiving upload of %zd bytes", m_remaining);
+
+    return ESP_OK;
+}
+
+std::expected<std::size_t, esp_err_t> HttpdOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (!m_remaining || buffer.empty())
+        return 0;
+
+    const auto result = httpd_req_recv(m_req, reinterpret_cast<char *>(buffer.data()), std::min(buffer.size(), m_remaining));
+    if (result == HTTPD_SOCK_ERR_TIMEOUT)
+    {
+        // lets the perform loop look at abort requests in between
+        if (++m_timeouts < MAX_TIMEOUTS)
+            return std::unexpected(ESP_ERR_HTTP_EAGAIN);
+        ESP_LOGE(TAG, "upload stalled with %zd bytes left", m_remaining);
+        return std::unexpected(ESP_ERR_TIMEOUT);
+    }
+    if (result <= 0)
+    {
+        ESP_LOGE(TAG, "httpd_req_recv() failed with %i", result);
+        return std::unexpected(ESP_ERR_INVALID_RESPONSE);
+    }
+
+    m_timeouts = 0;
+    m_remaining -= result;
+
+    return result;
+}
+
+void HttpdOtaTransport::respond(const char *status, std::string_view body)
+{
+    if (!m_req)
+        return;
+
+    httpd_resp_set_status(m_req, status);
+    httpd_resp_set_type(m_req, "text/plain");
+    if (const auto result = httpd_resp_send(m_req, body.data(), body.size()); result != ESP_OK)
+        ESP_LOGW(TAG, "httpd_resp_send() failed with %s", esp_err_to_name(result));
+
+    httpd_req_async_handler_complete(m_req);
+    m_req = nullptr;
+}
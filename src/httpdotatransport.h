@@ -0,0 +1,39 @@
+#pragma once
+
+// system includes
+#include <string>
+
+// esp-idf includes
+#include <esp_http_server.h>
+
+// local includes
+#include "otatransport.h"
+
+// Streams the body of an incoming POST request. Takes over a request detached
+// with httpd_req_async_handler_begin(), so the ota task can receive on it after
+// the handler returned. httpd_req_recv() copies from the socket straight into
+// the pipeline block passed to read(). The body can only be read once.
+class HttpdOtaTransport : public OtaTransport
+{
+public:
+    explicit HttpdOtaTransport(httpd_req_t *req);
+    ~HttpdOtaTransport() override;
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override { return m_contentLength; }
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override {}
+    std::string_view contentEncoding() const override { return m_contentEncoding; }
+    bool resumable() const override { return false; }
+
+    // sends the final response and hands the request back to the server
+    void respond(const char *status, std::string_view body);
+
+private:
+    httpd_req_t *m_req;
+    const std::size_t m_contentLength;
+    std::string m_contentEncoding;
+    bool m_opened{};
+    std::size_t m_remaining{};
+    int m_timeouts{};
+};
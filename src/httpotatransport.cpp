@@ -0,0 +1,239 @@
+#include "httpotatransport.h"
+
+// system includes
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <strings.h>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_crt_bundle.h>
+#include <esp_timer.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr int MAX_REDIRECTS = 5;
+
+bool isRedirect(int statusCode)
+{
+    switch (statusCode)
+    {
+    case 301: case 302: case 303: case 307: case 308: return true;
+    default: return false;
+    }
+}
+} // namespace
+
+HttpOtaTransport::HttpOtaTransport(std::string_view url, std::string_view cert_pem, bool use_global_ca,
+                                   std::string_view client_key, std::string_view client_cert) :
+    m_url{url},
+    m_cert_pem{cert_pem},
+    m_use_global_ca{use_global_ca},
+    m_client_key{client_key},
+    m_client_cert{client_cert}
+{
+}
+
+HttpOtaTransport::~HttpOtaTransport()
+{
+    close();
+}
+
+esp_err_t HttpOtaTransport::open(std::size_t offset)
+{
+    close();
+
+    if (const auto result = init(); result != ESP_OK)
+        return result;
+
+    return request(offset, std::nullopt);
+}
+
+esp_err_t HttpOtaTransport::openRange(std::size_t offset, std::size_t length)
+{
+    // the connection can only be kept alive once the previous response was read completely
+    if (m_client && !esp_http_client_is_complete_data_received(m_client))
+        close();
+
+    if (!m_client)
+        if (const auto result = init(); result != ESP_OK)
+            return result;
+
+    return request(offset, length);
+}
+
+esp_err_t HttpOtaTransport::init()
+{
+    esp_http_client_config_t config{};
+    config.url = m_url.c_str();
+    if (!m_cert_pem.empty())
+    {
+        config.cert_pem = m_cert_pem.data();
+        config.cert_len = m_cert_pem.size();
+    }
+    config.skip_cert_common_name_check = false;
+    config.event_handler = httpEventHandler;
+    config.user_data = this;
+
+    if (m_use_global_ca)
+    {
+        //config.use_global_ca_store = true;
+        config.crt_bundle_attach = esp_crt_bundle_attach;
+    }
+
+    if (!m_client_key.empty())
+    {
+        config.client_key_pem = m_client_key.data();
+        config.client_key_len = m_client_key.size();
+    }
+
+    if (!m_client_cert.empty())
+    {
+        config.client_cert_pem = m_client_cert.data();
+        config.client_cert_len = m_client_cert.size();
+    }
+
+    m_client = esp_http_client_init(&config);
+    if (!m_client)
+    {
+        ESP_LOGE(TAG, "esp_http_client_init() failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t HttpOtaTransport::request(std::size_t offset, std::optional<std::size_t> length)
+{
+    m_contentLength = std::nullopt;
+    m_connectTimings = std::nullopt;
+
+    const bool ranged = offset || length;
+    if (ranged)
+    {
+        const auto range = length ? std::format("bytes={}-{}", offset, offset + *length - 1) : std::format("bytes={}-", offset);
+        if (const auto result = esp_http_client_set_header(m_client, "Range", range.c_str()); result != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_http_client_set_header() failed with %s", esp_err_to_name(result));
+            close();
+            return result;
+        }
+    }
+
+    for (int redirects = 0; ; redirects++)
+    {
+        m_contentEncoding.clear();
+        m_etag.clear();
+        m_rangeTotal = std::nullopt;
+
+        const auto start = esp_timer_get_time();
+        m_connectedTs = 0;
+
+        if (const auto result = esp_http_client_open(m_client, 0); result != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_http_client_open() failed with %s", esp_err_to_name(result));
+            close();
+            return result;
+        }
+
+        const auto contentLength = esp_http_client_fetch_headers(m_client);
+        if (contentLength < 0)
+        {
+            ESP_LOGE(TAG, "esp_http_client_fetch_headers() failed with %lli", contentLength);
+            close();
+            return ESP_ERR_HTTP_FETCH_HEADER;
+        }
+
+        m_statusCode = esp_http_client_get_status_code(m_client);
+
+        const auto connected = m_connectedTs ? m_connectedTs : start;
+        m_connectTimings = OtaConnectTimings {
+            .connect = std::chrono::microseconds{connected - start},
+            .response = std::chrono::microseconds{esp_timer_get_time() - connected}
+        };
+
+        if (isRedirect(m_statusCode) && redirects < MAX_REDIRECTS)
+        {
+            ESP_LOGI(TAG, "following redirect (status %i)", m_statusCode);
+            esp_http_client_flush_response(m_client, nullptr);
+            if (const auto result = esp_http_client_set_redirection(m_client); result != ESP_OK)
+            {
+                ESP_LOGE(TAG, "esp_http_client_set_redirection() failed with %s", esp_err_to_name(result));
+                close();
+                return result;
+            }
+            esp_http_client_close(m_client);
+            continue;
+        }
+
+        if (m_statusCode != (ranged ? 206 : 200))
+        {
+            ESP_LOGE(TAG, "unexpected http status %i", m_statusCode);
+            close();
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        if (length)
+            m_contentLength = m_rangeTotal;
+        else if (contentLength > 0)
+            m_contentLength = offset + contentLength;
+
+        return ESP_OK;
+    }
+}
+
+std::expected<std::size_t, esp_err_t> HttpOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (!m_client)
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+
+    const auto result = esp_http_client_read(m_client, reinterpret_cast<char *>(buffer.data()), buffer.size());
+    if (result < 0)
+        return std::unexpected(result == -ESP_ERR_HTTP_EAGAIN ? ESP_ERR_HTTP_EAGAIN : ESP_FAIL);
+
+    if (result == 0 && !esp_http_client_is_complete_data_received(m_client))
+        return std::unexpected(ESP_ERR_HTTP_INCOMPLETE_DATA);
+
+    return result;
+}
+
+/*static*/ esp_err_t HttpOtaTransport::httpEventHandler(esp_http_client_event_t *evt)
+{
+    auto _this = reinterpret_cast<HttpOtaTransport*>(evt->user_data);
+
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED && _this)
+        _this->m_connectedTs = esp_timer_get_time();
+    else if (evt->event_id == HTTP_EVENT_ON_HEADER && _this && evt->header_key && evt->header_value)
+    {
+        if (strcasecmp(evt->header_key, "Content-Encoding") == 0)
+            _this->m_contentEncoding = evt->header_value;
+        else if (strcasecmp(evt->header_key, "ETag") == 0)
+            _this->m_etag = evt->header_value;
+        else if (strcasecmp(evt->header_key, "Content-Range") == 0)
+        {
+            // bytes <first>-<last>/<total>
+            if (const char * const total = strchr(evt->header_value, '/'); total && *(total + 1) != '*')
+            {
+                std::size_t value;
+                if (const auto [ptr, ec] = std::from_chars(total + 1, total + strlen(total), value); ec == std::errc{})
+                    _this->m_rangeTotal = value;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+void HttpOtaTransport::close()
+{
+    m_contentLength = std::nullopt;
+
+    if (!m_client)
+        return;
+
+    esp_http_client_close(m_client);
+    esp_http_client_cleanup(m_client);
+    m_client = {};
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// system includes
+#include <string>
+#include <string_view>
+
+// esp-idf includes
+#include <esp_http_client.h>
+
+// local includes
+#include "otatransport.h"
+
+class HttpOtaTransport : public OtaTransport
+{
+public:
+    HttpOtaTransport(std::string_view url, std::string_view cert_pem, bool use_global_ca,
+                     std::string_view client_key, std::string_view client_cert);
+    ~HttpOtaTransport() override;
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override { return m_contentLength; }
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override;
+    std::string_view contentEncoding() const override { return m_contentEncoding; }
+    std::string_view etag() const override { return m_etag; }
+
+    // fetches bytes [offset, offset + length), reusing the connection when possible.
+    // contentLength() then reports the total size from Content-Range.
+    esp_err_t openRange(std::size_t offset, std::size_t length);
+
+    const std::string &url() const { return m_url; }
+    int statusCode() const override { return m_statusCode; }
+    std::optional<OtaConnectTimings> connectTimings() const override { return m_connectTimings; }
+
+private:
+    static esp_err_t httpEventHandler(esp_http_client_event_t *evt);
+
+    esp_err_t init();
+    esp_err_t request(std::size_t offset, std::optional<std::size_t> length);
+
+    std::string m_url;
+    std::string_view m_cert_pem;
+    bool m_use_global_ca;
+    std::string_view m_client_key;
+    std::string_view m_client_cert;
+
+    esp_http_client_handle_t m_client{};
+    std::optional<std::size_t> m_contentLength;
+    std::optional<std::size_t> m_rangeTotal;
+    int m_statusCode{};
+    std::optional<OtaConnectTimings> m_connectTimings;
+    int64_t m_connectedTs{};
+    std::string m_contentEncoding;
+    std::string m_etag;
+};
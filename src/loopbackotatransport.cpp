@@ -0,0 +1,84 @@
+#include "loopbackotatransport.h"
+
+// system includes
+#include <algorithm>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_http_client.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// local includes
+#include "tickchrono.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+std::chrono::microseconds timestamp()
+{
+    return std::chrono::microseconds{esp_timer_get_time()};
+}
+} // namespace
+
+LoopbackOtaTransport::LoopbackOtaTransport(std::span<const uint8_t> image, const OtaLoopbackLink &link) :
+    m_image{image},
+    m_link{link}
+{
+    // one segment of burst, so the pacing is visible at the read granularity
+    m_bucket.configure({ .bytesPerSecond = m_link.bytesPerSecond, .burst = m_link.segmentSize }, timestamp());
+}
+
+esp_err_t LoopbackOtaTransport::open(std::size_t offset)
+{
+    if (offset > m_image.size())
+    {
+        ESP_LOGE(TAG, "range %zd beyond image size %zd", offset, m_image.size());
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const auto start = timestamp();
+    wait(m_link.rtt);
+
+    m_opened = true;
+    m_offset = offset;
+    m_position = offset;
+    m_opens++;
+    m_timings = OtaConnectTimings{ .connect = {}, .response = timestamp() - start };
+
+    return ESP_OK;
+}
+
+std::expected<std::size_t, esp_err_t> LoopbackOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (!m_opened)
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+
+    if (m_link.dropAt && !m_dropped && m_position >= *m_link.dropAt)
+    {
+        ESP_LOGW(TAG, "loopback connection dropped at %zd", m_position);
+        m_dropped = true;
+        m_opened = false;
+        return std::unexpected(ESP_ERR_HTTP_INCOMPLETE_DATA);
+    }
+
+    auto count = std::min({buffer.size(), m_link.segmentSize, m_image.size() - m_position});
+    if (m_link.dropAt && !m_dropped && *m_link.dropAt > m_position)
+        count = std::min(count, *m_link.dropAt - m_position);
+    if (!count)
+        return 0;
+
+    wait(m_bucket.consume(count, timestamp()));
+
+    std::copy_n(std::begin(m_image) + m_position, count, std::begin(buffer));
+    m_position += count;
+
+    return count;
+}
+
+void LoopbackOtaTransport::wait(std::chrono::microseconds duration)
+{
+    if (duration.count() > 0)
+        vTaskDelay(std::chrono::ceil<espcpputils::ticks>(duration).count());
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// local includes
+#include "otatransport.h"
+#include "otatokenbucket.h"
+
+// Simulated link of a LoopbackOtaTransport. Every open() costs one round trip,
+// reads are paced to bytesPerSecond (0 for unlimited) and return at most one
+// segment. dropAt cuts the first connection that gets there, to exercise
+// retries and resume.
+struct OtaLoopbackLink
+{
+    std::chrono::milliseconds rtt{};
+    std::size_t bytesPerSecond{};
+    std::size_t segmentSize{1460};
+    std::optional<std::size_t> dropAt;
+};
+
+// Serves an image from memory as if it came over the network, for host builds
+// and benchmarks. Supports ranged opens like HttpOtaTransport.
+class LoopbackOtaTransport : public OtaTransport
+{
+public:
+    explicit LoopbackOtaTransport(std::span<const uint8_t> image, const OtaLoopbackLink &link = {});
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override { return m_image.size() - m_offset; }
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override { m_opened = false; }
+    std::string_view etag() const override { return "\"loopback\""; }
+    std::optional<OtaConnectTimings> connectTimings() const override { return m_timings; }
+
+    std::size_t opens() const { return m_opens; }
+
+private:
+    void wait(std::chrono::microseconds duration);
+
+    const std::span<const uint8_t> m_image;
+    const OtaLoopbackLink m_link;
+    OtaTokenBucket m_bucket;
+    bool m_opened{};
+    bool m_dropped{};
+    std::size_t m_offset{};
+    std::size_t m_position{};
+    std::size_t m_opens{};
+    std::optional<OtaConnectTimings> m_timings;
+};
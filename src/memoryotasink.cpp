@@ -0,0 +1,57 @@
+#include "memoryotasink.h"
+
+// system includes
+#include <algorithm>
+
+// esp-idf includes
+#include <esp_log.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+} // namespace
+
+esp_err_t MemoryOtaSink::begin(std::optional<std::size_t> imageSize, std::size_t offset)
+{
+    if (imageSize && *imageSize > m_storage.size())
+    {
+        ESP_LOGE(TAG, "image size %zd exceeds memory sink size %zd", *imageSize, m_storage.size());
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (offset > m_storage.size())
+        return ESP_ERR_INVALID_ARG;
+
+    m_active = true;
+    m_position = offset;
+    m_finishedSize = 0;
+
+    return ESP_OK;
+}
+
+esp_err_t MemoryOtaSink::write(std::span<const uint8_t> data)
+{
+    if (!m_active)
+        return ESP_ERR_INVALID_STATE;
+
+    if (data.size() > m_storage.size() - m_position)
+    {
+        ESP_LOGE(TAG, "image exceeds memory sink size %zd", m_storage.size());
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    std::copy(std::begin(data), std::end(data), std::begin(m_storage) + m_position);
+    m_position += data.size();
+
+    return ESP_OK;
+}
+
+esp_err_t MemoryOtaSink::finish()
+{
+    if (!m_active)
+        return ESP_ERR_INVALID_STATE;
+
+    m_active = false;
+    m_finishedSize = m_position;
+
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// esp-idf includes
+#include <esp_err.h>
+
+// local includes
+#include "otasink.h"
+
+// Writes the image into caller owned memory instead of flash, for host builds
+// and benchmarks. Not bootable by default, so a finished job neither checks
+// the app header nor restarts.
+class MemoryOtaSink : public OtaSink
+{
+public:
+    explicit MemoryOtaSink(std::span<uint8_t> storage, bool bootable = false) : m_storage{storage}, m_bootable{bootable} {}
+
+    esp_err_t begin(std::optional<std::size_t> imageSize, std::size_t offset) override;
+    esp_err_t write(std::span<const uint8_t> data) override;
+    esp_err_t finish() override;
+    void abort() override { m_active = false; }
+
+    bool bootable() const override { return m_bootable; }
+
+    // what the last finished job left behind, empty before
+    std::span<const uint8_t> image() const { return m_storage.first(m_finishedSize); }
+
+private:
+    const std::span<uint8_t> m_storage;
+    const bool m_bootable;
+    bool m_active{};
+    std::size_t m_position{};
+    std::size_t m_finishedSize{};
+};
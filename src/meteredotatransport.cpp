@@ -0,0 +1,18 @@
+#include "meteredotatransport.h"
+
+// esp-idf includes
+#include <esp_timer.h>
+
+std::expected<std::size_t, esp_err_t> MeteredOtaTransport::read(std::span<uint8_t> buffer)
+{
+    const auto start = esp_timer_get_time();
+    const auto result = m_inner.read(buffer);
+    const std::chrono::microseconds duration{esp_timer_get_time() - start};
+    m_waited += duration;
+    if (result && *result)
+    {
+        m_latency.record(duration);
+        m_received += *result;
+    }
+    return result;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// local includes
+#include "otatransport.h"
+#include "otalatencyhistogram.h"
+
+// Pass-through that counts and times the reads of the network transport, below
+// decompression and delta reconstruction, so rate limiting sees link bytes and
+// the read latency excludes inflating and base partition reads.
+class MeteredOtaTransport : public OtaTransport
+{
+public:
+    MeteredOtaTransport(OtaTransport &inner, OtaLatencyHistogram &latency) : m_inner{inner}, m_latency{latency} {}
+
+    esp_err_t open(std::size_t offset) override { return m_inner.open(offset); }
+    std::optional<std::size_t> contentLength() const override { return m_inner.contentLength(); }
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override { m_inner.close(); }
+    std::string_view contentEncoding() const override { return m_inner.contentEncoding(); }
+    std::string_view etag() const override { return m_inner.etag(); }
+    bool resumable() const override { return m_inner.resumable(); }
+    int statusCode() const override { return m_inner.statusCode(); }
+    std::optional<OtaConnectTimings> connectTimings() const override { return m_inner.connectTimings(); }
+
+    std::size_t received() const { return m_received; }
+    // total time spent inside read(), including reads that returned no data
+    std::chrono::microseconds waited() const { return m_waited; }
+
+private:
+    OtaTransport &m_inner;
+    OtaLatencyHistogram &m_latency;
+    std::size_t m_received{};
+    std::chrono::microseconds m_waited{};
+};
@@ -0,0 +1,154 @@
+#include "mirroredotatransport.h"
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_timer.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+} // namespace
+
+MirroredOtaTransport::MirroredOtaTransport(std::string_view cert_pem, bool use_global_ca,
+                                           std::string_view client_key, std::string_view client_cert) :
+    m_cert_pem{cert_pem},
+    m_use_global_ca{use_global_ca},
+    m_client_key{client_key},
+    m_client_cert{client_cert}
+{
+}
+
+void MirroredOtaTransport::setMirrors(std::span<const std::string> urls)
+{
+    m_mirrors.clear();
+    m_mirrors.reserve(urls.size());
+    for (const auto &url : urls)
+        m_mirrors.emplace_back(std::make_unique<HttpOtaTransport>(url, m_cert_pem, m_use_global_ca, m_client_key, m_client_cert));
+
+    m_current = 0;
+    m_probed = false;
+    m_imageSize = std::nullopt;
+}
+
+esp_err_t MirroredOtaTransport::open(std::size_t offset)
+{
+    if (m_mirrors.empty())
+        return ESP_ERR_INVALID_STATE;
+
+    if (!m_probed)
+        return probe(offset);
+
+    esp_err_t result{ESP_FAIL};
+    for (std::size_t i = 0; i < m_mirrors.size(); i++)
+    {
+        const auto index = (m_current + i) % m_mirrors.size();
+        result = m_mirrors[index]->open(offset);
+        if (result != ESP_OK)
+        {
+            ESP_LOGW(TAG, "mirror %zd failed with %s", index, esp_err_to_name(result));
+            continue;
+        }
+
+        if (m_mirrors[index]->contentLength() != m_imageSize)
+        {
+            ESP_LOGW(TAG, "mirror %zd serves a different image", index);
+            m_mirrors[index]->close();
+            result = ESP_ERR_INVALID_RESPONSE;
+            continue;
+        }
+
+        if (index != m_current)
+            ESP_LOGI(TAG, "switched to mirror %zd at %zd", index, offset);
+        m_current = index;
+        return ESP_OK;
+    }
+
+    return result;
+}
+
+std::optional<std::size_t> MirroredOtaTransport::contentLength() const
+{
+    return m_mirrors.empty() ? std::nullopt : m_mirrors[m_current]->contentLength();
+}
+
+std::expected<std::size_t, esp_err_t> MirroredOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (m_mirrors.empty())
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+    return m_mirrors[m_current]->read(buffer);
+}
+
+void MirroredOtaTransport::close()
+{
+    for (auto &mirror : m_mirrors)
+        mirror->close();
+}
+
+std::string_view MirroredOtaTransport::contentEncoding() const
+{
+    return m_mirrors.empty() ? std::string_view{} : m_mirrors[m_current]->contentEncoding();
+}
+
+std::string_view MirroredOtaTransport::etag() const
+{
+    return m_mirrors.empty() ? std::string_view{} : m_mirrors[m_current]->etag();
+}
+
+int MirroredOtaTransport::statusCode() const
+{
+    return m_mirrors.empty() ? 0 : m_mirrors[m_current]->statusCode();
+}
+
+std::optional<OtaConnectTimings> MirroredOtaTransport::connectTimings() const
+{
+    return m_mirrors.empty() ? std::nullopt : m_mirrors[m_current]->connectTimings();
+}
+
+esp_err_t MirroredOtaTransport::probe(std::size_t offset)
+{
+    std::optional<std::size_t> best;
+    int64_t bestTime{};
+    esp_err_t result{ESP_FAIL};
+
+    for (std::size_t index = 0; index < m_mirrors.size(); index++)
+    {
+        // open() returns once the response headers are in
+        const auto start = esp_timer_get_time();
+        result = m_mirrors[index]->open(offset);
+        const auto elapsed = esp_timer_get_time() - start;
+
+        if (result != ESP_OK)
+        {
+            ESP_LOGW(TAG, "mirror %zd failed with %s", index, esp_err_to_name(result));
+            continue;
+        }
+
+        ESP_LOGI(TAG, "mirror %zd answered after %lldms", index, elapsed / 1000);
+
+        if (best && m_mirrors[index]->contentLength() != m_mirrors[*best]->contentLength())
+        {
+            ESP_LOGW(TAG, "mirror %zd serves a different image", index);
+            m_mirrors[index]->close();
+            continue;
+        }
+
+        if (!best || elapsed < bestTime)
+        {
+            if (best)
+                m_mirrors[*best]->close();
+            best = index;
+            bestTime = elapsed;
+        }
+        else
+            m_mirrors[index]->close();
+    }
+
+    if (!best)
+        return result;
+
+    ESP_LOGI(TAG, "using mirror %zd", *best);
+    m_current = *best;
+    m_probed = true;
+    m_imageSize = m_mirrors[*best]->contentLength();
+
+    return ESP_OK;
+}
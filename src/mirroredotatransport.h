@@ -0,0 +1,45 @@
+#pragma once
+
+// system includes
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// local includes
+#include "httpotatransport.h"
+
+// Downloads from whichever of several equivalent mirrors answered fastest.
+// The first open() probes every mirror and keeps the one with the shortest
+// time to first byte. Later opens (resumes) try that mirror first and then
+// fall over to the others at the same offset.
+class MirroredOtaTransport : public OtaTransport
+{
+public:
+    MirroredOtaTransport(std::string_view cert_pem, bool use_global_ca,
+                         std::string_view client_key, std::string_view client_cert);
+
+    void setMirrors(std::span<const std::string> urls);
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override;
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override;
+    std::string_view contentEncoding() const override;
+    std::string_view etag() const override;
+    int statusCode() const override;
+    std::optional<OtaConnectTimings> connectTimings() const override;
+
+private:
+    esp_err_t probe(std::size_t offset);
+
+    std::string_view m_cert_pem;
+    bool m_use_global_ca;
+    std::string_view m_client_key;
+    std::string_view m_client_cert;
+
+    std::vector<std::unique_ptr<HttpOtaTransport>> m_mirrors;
+    std::size_t m_current{};
+    bool m_probed{};
+    std::optional<std::size_t> m_imageSize;
+};
@@ -0,0 +1,237 @@
+#include "otablockpipeline.h"
+
+// system includes
+#include <cassert>
+#include <new>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_timer.h>
+
+// local includes
+#include "otastaticstorage.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+} // namespace
+
+OtaBlockPipeline::OtaBlockPipeline(OtaSink &sink, std::size_t blockCount, std::size_t blockSize,
+                                   espcpputils::CoreAffinity coreAffinity, uint32_t stackSize,
+                                   const Storage *storage) :
+    m_sink{sink},
+    m_blockCount{blockCount ? blockCount : 1},
+    m_blockSize{blockSize},
+    m_coreAffinity{coreAffinity},
+    m_stackSize{stackSize},
+    m_storage{storage}
+{
+    assert(m_blockSize);
+}
+
+OtaBlockPipeline::~OtaBlockPipeline()
+{
+    stop();
+
+    if (m_writerDone)
+        vSemaphoreDelete(m_writerDone);
+    if (m_fullQueue)
+        vQueueDelete(m_fullQueue);
+    if (m_freeQueue)
+        vQueueDelete(m_freeQueue);
+}
+
+esp_err_t OtaBlockPipeline::start()
+{
+    if (m_storage)
+    {
+        if (m_storage->memory.size() < m_blockCount * m_blockSize || m_storage->blocks.size() < m_blockCount ||
+            (pipelined() && (m_storage->queueItems.size() < 2 * m_blockCount + 1 || m_storage->writerStack.empty() || !m_storage->writerTcb)))
+        {
+            ESP_LOGE(TAG, "static storage too small for %zd blocks of %zd bytes", m_blockCount, m_blockSize);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        m_memory = m_storage->memory.data();
+        m_blocks = m_storage->blocks.data();
+    }
+    else
+    {
+        m_ownedMemory.reset(new (std::nothrow) uint8_t[m_blockCount * m_blockSize]);
+        m_ownedBlocks.reset(new (std::nothrow) Block[m_blockCount]);
+        if (!m_ownedMemory || !m_ownedBlocks)
+        {
+            ESP_LOGE(TAG, "could not allocate %zd blocks of %zd bytes", m_blockCount, m_blockSize);
+            return ESP_ERR_NO_MEM;
+        }
+        m_memory = m_ownedMemory.get();
+        m_blocks = m_ownedBlocks.get();
+    }
+
+    for (std::size_t i = 0; i < m_blockCount; i++)
+        m_blocks[i] = Block{ .data = &m_memory[i * m_blockSize], .size = 0 };
+
+    if (!pipelined())
+        return ESP_OK;
+
+    if (m_storage)
+    {
+        const auto items = reinterpret_cast<uint8_t *>(m_storage->queueItems.data());
+        m_freeQueue = xQueueCreateStatic(m_blockCount, sizeof(Block *), items, &m_freeQueueBuffer);
+        m_fullQueue = xQueueCreateStatic(m_blockCount + 1, sizeof(Block *), items + m_blockCount * sizeof(Block *), &m_fullQueueBuffer);
+        m_writerDone = xSemaphoreCreateBinaryStatic(&m_writerDoneBuffer);
+    }
+    else
+    {
+        m_freeQueue = xQueueCreate(m_blockCount, sizeof(Block *));
+        m_fullQueue = xQueueCreate(m_blockCount + 1, sizeof(Block *));
+        m_writerDone = xSemaphoreCreateBinary();
+    }
+    if (!m_freeQueue || !m_fullQueue || !m_writerDone)
+    {
+        ESP_LOGE(TAG, "could not create pipeline queues");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (std::size_t i = 0; i < m_blockCount; i++)
+    {
+        Block *block = &m_blocks[i];
+        xQueueSend(m_freeQueue, &block, 0);
+    }
+
+    BaseType_t result{pdPASS};
+    if (m_storage)
+        m_writerHandle = createOtaStaticTask(writerTask, "asyncOtaWriter", {m_storage->writerStack, m_storage->writerTcb},
+                                             this, uxTaskPriorityGet(NULL), m_coreAffinity);
+    else
+        result = espcpputils::createTask(writerTask, "asyncOtaWriter", m_stackSize, this,
+                                         uxTaskPriorityGet(NULL), &m_writerHandle, m_coreAffinity);
+    if (result != pdPASS || !m_writerHandle)
+    {
+        ESP_LOGE(TAG, "failed creating ota writer task %i", result);
+        m_writerHandle = {};
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void OtaBlockPipeline::stop()
+{
+    if (!m_writerHandle)
+        return;
+
+    m_error.store(ESP_ERR_INVALID_STATE);
+    drain();
+}
+
+std::expected<OtaBlockPipeline::Block *, esp_err_t> OtaBlockPipeline::acquire()
+{
+    if (const auto error = m_error.load(); error != ESP_OK)
+        return std::unexpected(error);
+
+    if (!pipelined())
+    {
+        m_blocks[0].size = 0;
+        return &m_blocks[0];
+    }
+
+    Block *block{};
+    if (xQueueReceive(m_freeQueue, &block, portMAX_DELAY) != pdTRUE || !block)
+        return std::unexpected(ESP_ERR_TIMEOUT);
+
+    if (const auto error = m_error.load(); error != ESP_OK)
+    {
+        release(block);
+        return std::unexpected(error);
+    }
+
+    block->size = 0;
+    return block;
+}
+
+void OtaBlockPipeline::release(Block *block)
+{
+    if (pipelined())
+        xQueueSend(m_freeQueue, &block, 0);
+}
+
+esp_err_t OtaBlockPipeline::submit(Block *block)
+{
+    assert(block);
+
+    if (!pipelined())
+    {
+        if (const auto result = write(*block); result != ESP_OK)
+        {
+            m_error.store(result);
+            return result;
+        }
+        return ESP_OK;
+    }
+
+    xQueueSend(m_fullQueue, &block, portMAX_DELAY);
+    return m_error.load();
+}
+
+esp_err_t OtaBlockPipeline::drain()
+{
+    if (!m_writerHandle)
+        return m_error.load();
+
+    Block *end{};
+    xQueueSend(m_fullQueue, &end, portMAX_DELAY);
+    xSemaphoreTake(m_writerDone, portMAX_DELAY);
+    deleteOtaTask(m_writerHandle);
+    m_writerHandle = {};
+
+    return m_error.load();
+}
+
+/*static*/ void OtaBlockPipeline::writerTask(void *arg)
+{
+    auto _this = reinterpret_cast<OtaBlockPipeline*>(arg);
+
+    assert(_this);
+
+    _this->writerTask();
+}
+
+void OtaBlockPipeline::writerTask()
+{
+    while (true)
+    {
+        Block *block{};
+        if (xQueueReceive(m_fullQueue, &block, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        if (!block)
+            break;
+
+        if (m_error.load() == ESP_OK)
+        {
+            if (const auto result = write(*block); result != ESP_OK)
+            {
+                ESP_LOGE(TAG, "write() failed with %s", esp_err_to_name(result));
+                esp_err_t expected{ESP_OK};
+                m_error.compare_exchange_strong(expected, result);
+            }
+        }
+
+        xQueueSend(m_freeQueue, &block, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(m_writerDone);
+    // deleted by drain(), see deleteOtaTask()
+    vTaskSuspend(NULL);
+}
+
+esp_err_t OtaBlockPipeline::write(const Block &block)
+{
+    const auto start = esp_timer_get_time();
+    const auto result = m_sink.write({block.data, block.size});
+    m_writeLatency.record(std::chrono::microseconds{esp_timer_get_time() - start});
+
+    if (result == ESP_OK)
+        m_committed.fetch_add(block.size, std::memory_order_relaxed);
+
+    return result;
+}
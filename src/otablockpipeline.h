@@ -0,0 +1,91 @@
+#pragma once
+
+// system includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <span>
+
+// esp-idf includes
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// local includes
+#include "taskutils.h"
+#include "otasink.h"
+#include "otalatencyhistogram.h"
+
+// Bounded ring of pre-allocated blocks between the network reader (the ota task)
+// and a writer task feeding the OtaSink. With less than 2 blocks no writer task
+// is created and submit() writes synchronously.
+class OtaBlockPipeline
+{
+public:
+    struct Block
+    {
+        uint8_t *data;
+        std::size_t size;
+    };
+
+    // caller owned memory, the pipeline does not touch the heap when given
+    struct Storage
+    {
+        std::span<uint8_t> memory;          // blockCount * blockSize
+        std::span<Block> blocks;            // blockCount
+        std::span<Block *> queueItems;      // 2 * blockCount + 1
+        std::span<StackType_t> writerStack; // overrides stackSize
+        StaticTask_t *writerTcb;
+    };
+
+    OtaBlockPipeline(OtaSink &sink, std::size_t blockCount, std::size_t blockSize,
+                     espcpputils::CoreAffinity coreAffinity, uint32_t stackSize=4096,
+                     const Storage *storage=nullptr);
+    ~OtaBlockPipeline();
+
+    esp_err_t start();
+    void stop();
+
+    std::expected<Block *, esp_err_t> acquire();
+    void release(Block *block);
+    esp_err_t submit(Block *block);
+    esp_err_t drain();
+
+    std::size_t blockSize() const { return m_blockSize; }
+    std::size_t committed() const { return m_committed.load(std::memory_order_relaxed); }
+    bool pipelined() const { return m_blockCount > 1; }
+    // only stable once drain() returned
+    const OtaLatencyHistogram &writeLatency() const { return m_writeLatency; }
+
+private:
+    static void writerTask(void *arg);
+    void writerTask();
+    esp_err_t write(const Block &block);
+
+    OtaSink &m_sink;
+    const std::size_t m_blockCount;
+    const std::size_t m_blockSize;
+    const espcpputils::CoreAffinity m_coreAffinity;
+    const uint32_t m_stackSize;
+    const Storage * const m_storage;
+
+    std::unique_ptr<uint8_t[]> m_ownedMemory;
+    std::unique_ptr<Block[]> m_ownedBlocks;
+    uint8_t *m_memory{};
+    Block *m_blocks{};
+
+    StaticQueue_t m_freeQueueBuffer;
+    StaticQueue_t m_fullQueueBuffer;
+    StaticSemaphore_t m_writerDoneBuffer;
+
+    QueueHandle_t m_freeQueue{};
+    QueueHandle_t m_fullQueue{};
+    SemaphoreHandle_t m_writerDone{};
+    TaskHandle_t m_writerHandle{};
+
+    std::atomic<esp_err_t> m_error{ESP_OK};
+    std::atomic<std::size_t> m_committed{};
+    OtaLatencyHistogram m_writeLatency;
+};
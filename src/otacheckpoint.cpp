@@ -0,0 +1,79 @@
+#include "otacheckpoint.h"
+
+// esp-idf includes
+#include <esp_log.h>
+#include <nvs.h>
+
+// local includes
+#include "cleanuphelper.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr const char * const NVS_NAMESPACE = "espasyncota";
+} // namespace
+
+uint64_t otaImageIdentity(std::string_view id)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c : id)
+    {
+        hash ^= uint8_t(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::expected<OtaCheckpoint, esp_err_t> loadOtaCheckpoint(const char *key)
+{
+    nvs_handle_t handle;
+    if (const auto result = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle); result != ESP_OK)
+        return std::unexpected(result);
+
+    auto helper = cpputils::makeCleanupHelper([&](){ nvs_close(handle); });
+
+    OtaCheckpoint checkpoint;
+    std::size_t size = sizeof(checkpoint);
+    if (const auto result = nvs_get_blob(handle, key, &checkpoint, &size); result != ESP_OK)
+        return std::unexpected(result);
+
+    if (size != sizeof(checkpoint))
+        return std::unexpected(ESP_ERR_INVALID_SIZE);
+
+    return checkpoint;
+}
+
+esp_err_t saveOtaCheckpoint(const char *key, const OtaCheckpoint &checkpoint)
+{
+    nvs_handle_t handle;
+    if (const auto result = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle); result != ESP_OK)
+    {
+        ESP_LOGW(TAG, "nvs_open() failed with %s", esp_err_to_name(result));
+        return result;
+    }
+
+    auto helper = cpputils::makeCleanupHelper([&](){ nvs_close(handle); });
+
+    if (const auto result = nvs_set_blob(handle, key, &checkpoint, sizeof(checkpoint)); result != ESP_OK)
+    {
+        ESP_LOGW(TAG, "nvs_set_blob() failed with %s", esp_err_to_name(result));
+        return result;
+    }
+
+    return nvs_commit(handle);
+}
+
+esp_err_t clearOtaCheckpoint(const char *key)
+{
+    nvs_handle_t handle;
+    if (const auto result = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle); result != ESP_OK)
+        return result;
+
+    auto helper = cpputils::makeCleanupHelper([&](){ nvs_close(handle); });
+
+    if (const auto result = nvs_erase_key(handle, key); result != ESP_OK)
+        return result == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : result;
+
+    return nvs_commit(handle);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// system includes
+#include <cstdint>
+#include <expected>
+#include <string_view>
+
+// esp-idf includes
+#include <esp_err.h>
+
+// Progress of a partially written image, persisted in NVS so that a job
+// interrupted by a reset can continue where it left off.
+struct OtaCheckpoint
+{
+    uint32_t partitionAddress;
+    uint32_t imageSize;
+    uint64_t identity;
+    uint32_t committed;
+};
+
+uint64_t otaImageIdentity(std::string_view id);
+
+std::expected<OtaCheckpoint, esp_err_t> loadOtaCheckpoint(const char *key);
+esp_err_t saveOtaCheckpoint(const char *key, const OtaCheckpoint &checkpoint);
+esp_err_t clearOtaCheckpoint(const char *key);
@@ -0,0 +1,31 @@
+#include "otaerrorrecord.h"
+
+// system includes
+#include <algorithm>
+#include <format>
+
+std::size_t OtaErrorRecord::format(std::span<char> buffer) const
+{
+    if (buffer.empty())
+        return 0;
+
+    const auto limit = buffer.size() - 1;
+    std::size_t size;
+    if (!phase)
+        size = 0;
+    else if (aborted)
+        size = std::format_to_n(buffer.data(), limit, "Requested abort (at {})", timestamp.count()).size;
+    else
+        size = std::format_to_n(buffer.data(), limit, "{}() failed with {} (http {}, offset {}, at {})",
+                                phase, esp_err_to_name(error), httpStatus, offset, timestamp.count()).size;
+
+    size = std::min<std::size_t>(size, limit);
+    buffer[size] = '\0';
+    return size;
+}
+
+std::string OtaErrorRecord::toString() const
+{
+    char buffer[128];
+    return {buffer, format(buffer)};
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <string>
+
+// esp-idf includes
+#include <esp_err.h>
+
+// Why the last job failed, recorded without allocating. Formatting is left to
+// whoever reads it.
+struct OtaErrorRecord
+{
+    const char *phase{}; // string literal naming the failed step, e.g. "open" or "write"
+    esp_err_t error{ESP_OK};
+    int httpStatus{};
+    std::size_t offset{};
+    std::chrono::milliseconds timestamp{};
+    bool aborted{};
+
+    explicit operator bool() const { return phase; }
+
+    // writes a null terminated message, truncated to the buffer, returns its length
+    std::size_t format(std::span<char> buffer) const;
+    std::string toString() const;
+};
@@ -0,0 +1,135 @@
+#include "otaimagehasher.h"
+
+// system includes
+#include <algorithm>
+#include <cstring>
+
+// esp-idf includes
+#include <esp_app_format.h>
+
+OtaImageHasher::OtaImageHasher(bool appImage) :
+    m_stage{appImage ? Stage::ImageHeader : Stage::None},
+    m_fieldLength{sizeof(esp_image_header_t)}
+{
+    static_assert(sizeof(esp_image_header_t) <= sizeof(m_field));
+
+    mbedtls_sha256_init(&m_context);
+    mbedtls_sha256_starts(&m_context, 0);
+}
+
+OtaImageHasher::~OtaImageHasher()
+{
+    mbedtls_sha256_free(&m_context);
+}
+
+void OtaImageHasher::update(std::span<const uint8_t> data)
+{
+    const auto consume = [&](std::size_t count){
+        hash(data.first(count));
+        m_size += count;
+        data = data.subspan(count);
+    };
+
+    while (!data.empty())
+    {
+        if (m_stage == Stage::Done || m_stage == Stage::None)
+        {
+            consume(data.size());
+            break;
+        }
+
+        if (m_size < m_fieldOffset)
+        {
+            consume(std::min(data.size(), m_fieldOffset - m_size));
+            continue;
+        }
+
+        // the digest covers everything in front of it
+        if (m_stage == Stage::Digest && !m_fieldSize)
+        {
+            mbedtls_sha256_context body;
+            mbedtls_sha256_init(&body);
+            mbedtls_sha256_clone(&body, &m_context);
+            mbedtls_sha256_finish(&body, m_bodyDigest.data());
+            mbedtls_sha256_free(&body);
+        }
+
+        const auto count = std::min(data.size(), m_fieldLength - m_fieldSize);
+        std::copy_n(std::begin(data), count, std::begin(m_field) + m_fieldSize);
+        m_fieldSize += count;
+        consume(count);
+
+        if (m_fieldSize == m_fieldLength)
+            parseField();
+    }
+}
+
+OtaImageHasher::Result OtaImageHasher::finish()
+{
+    Result result;
+
+    if (m_stage == Stage::Done)
+        result.appendedDigestMatches = std::equal(std::begin(m_bodyDigest), std::end(m_bodyDigest), std::begin(m_field));
+    else if (m_stage != Stage::None)
+        result.appendedDigestMatches = false; // ended before the digest
+
+    mbedtls_sha256_finish(&m_context, result.digest.data());
+
+    return result;
+}
+
+void OtaImageHasher::hash(std::span<const uint8_t> data)
+{
+    if (!data.empty())
+        mbedtls_sha256_update(&m_context, data.data(), data.size());
+}
+
+void OtaImageHasher::parseField()
+{
+    const auto next = [&](Stage stage, std::size_t offset, std::size_t length){
+        m_stage = stage;
+        m_fieldOffset = offset;
+        m_fieldLength = length;
+        m_fieldSize = 0;
+    };
+
+    // the checksum byte ends the segments, padded to 16 bytes, then the digest follows
+    const auto digestOffset = [](std::size_t segmentsEnd){
+        return (segmentsEnd + 1 + 15) & ~std::size_t{15};
+    };
+
+    switch (m_stage)
+    {
+    case Stage::ImageHeader:
+    {
+        esp_image_header_t header;
+        std::memcpy(&header, m_field.data(), sizeof(header));
+        if (header.magic != ESP_IMAGE_HEADER_MAGIC || header.hash_appended != 1 || header.segment_count > ESP_IMAGE_MAX_SEGMENTS)
+            next(Stage::None, 0, 0);
+        else if (!header.segment_count)
+            next(Stage::Digest, digestOffset(sizeof(header)), sizeof(OtaSha256));
+        else
+        {
+            m_segmentsLeft = header.segment_count;
+            next(Stage::SegmentHeader, sizeof(header), sizeof(esp_image_segment_header_t));
+        }
+        break;
+    }
+    case Stage::SegmentHeader:
+    {
+        esp_image_segment_header_t segment;
+        std::memcpy(&segment, m_field.data(), sizeof(segment));
+        const auto end = m_fieldOffset + sizeof(segment) + segment.data_len;
+        if (--m_segmentsLeft)
+            next(Stage::SegmentHeader, end, sizeof(segment));
+        else
+            next(Stage::Digest, digestOffset(end), sizeof(OtaSha256));
+        break;
+    }
+    case Stage::Digest:
+        m_stage = Stage::Done;
+        break;
+    default:
+        break;
+    }
+}
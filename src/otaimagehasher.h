@@ -0,0 +1,51 @@
+#pragma once
+
+// system includes
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// esp-idf includes
+#include <mbedtls/sha256.h>
+
+using OtaSha256 = std::array<uint8_t, 32>;
+
+// Streaming SHA-256 over the image as it is downloaded. For app images it also
+// follows the segment headers to find the SHA-256 appended behind the padded
+// segments, so it can be checked without reading back flash. Signature blocks
+// following the digest are left alone.
+class OtaImageHasher
+{
+public:
+    explicit OtaImageHasher(bool appImage);
+    ~OtaImageHasher();
+
+    void update(std::span<const uint8_t> data);
+
+    struct Result
+    {
+        OtaSha256 digest;
+        std::optional<bool> appendedDigestMatches;
+    };
+    Result finish();
+
+private:
+    enum class Stage : uint8_t { ImageHeader, SegmentHeader, Digest, Done, None };
+
+    void hash(std::span<const uint8_t> data);
+    void parseField();
+
+    mbedtls_sha256_context m_context;
+    std::size_t m_size{};
+
+    Stage m_stage;
+    std::size_t m_fieldOffset{};
+    std::size_t m_fieldLength{};
+    std::array<uint8_t, 32> m_field;
+    std::size_t m_fieldSize{};
+    std::size_t m_segmentsLeft{};
+
+    OtaSha256 m_bodyDigest;
+};
@@ -0,0 +1,35 @@
+#include "otajobstats.h"
+
+// system includes
+#include <format>
+
+float OtaJobStats::bytesPerSecond() const
+{
+    const auto transfer = imgDesc + perform;
+    if (transfer.count() <= 0)
+        return 0.f;
+    return bytes * 1000000.f / transfer.count();
+}
+
+std::string OtaJobStats::toJson() const
+{
+    const auto optional = [](const std::optional<std::chrono::microseconds> &value){
+        return value ? std::to_string(value->count()) : "null";
+    };
+
+    return std::format(R"({{"succeeded":{},"bytes":{},"bytesPerSecond":{:.0f},"retries":{},"connectUs":{},"responseUs":{},"beginUs":{},"firstByteUs":{},"imgDescUs":{},"performUs":{},"finishUs":{},"throttledUs":{},"totalUs":{},"cpuUs":{}}})",
+                       succeeded,
+                       bytes,
+                       bytesPerSecond(),
+                       retries,
+                       connect.count(),
+                       response.count(),
+                       begin.count(),
+                       optional(firstByte),
+                       imgDesc.count(),
+                       perform.count(),
+                       finish.count(),
+                       throttled.count(),
+                       total().count(),
+                       optional(cpuTime));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+struct OtaJobStats
+{
+    std::size_t bytes{};
+    int retries{};
+    std::chrono::microseconds connect{};  // DNS, TCP and TLS of the first open()
+    std::chrono::microseconds response{}; // first open() until its response headers
+    std::chrono::microseconds begin{};
+    std::chrono::microseconds imgDesc{};
+    std::chrono::microseconds perform{};
+    std::chrono::microseconds finish{};
+    std::optional<std::chrono::microseconds> firstByte; // since the job started
+    std::chrono::microseconds throttled{};              // slept on purpose during perform
+    std::optional<std::chrono::microseconds> cpuTime;
+    bool succeeded{};
+
+    std::chrono::microseconds total() const { return begin + imgDesc + perform + finish; }
+    float bytesPerSecond() const;
+    std::string toJson() const;
+};
@@ -0,0 +1,57 @@
+#include "otalatencyhistogram.h"
+
+// system includes
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <utility>
+
+void OtaLatencyHistogram::record(std::chrono::microseconds latency)
+{
+    const auto ticks = std::max<int64_t>(latency.count(), 0) / FIRST_BUCKET.count();
+    const std::size_t index = std::min<std::size_t>(std::bit_width(uint64_t(ticks)), BUCKET_COUNT - 1);
+
+    m_buckets[index]++;
+    m_count++;
+    m_sum += latency;
+    m_max = std::max(m_max, latency);
+}
+
+std::chrono::microseconds OtaLatencyHistogram::percentile(float percent) const
+{
+    if (!m_count)
+        return {};
+
+    const auto target = std::max<uint32_t>(1, uint32_t(m_count * percent / 100.f + .5f));
+    uint32_t seen{};
+    for (std::size_t i = 0; i < BUCKET_COUNT - 1; i++)
+    {
+        seen += m_buckets[i];
+        if (seen >= target)
+            return std::min(bucketLimit(i), m_max);
+    }
+
+    return m_max;
+}
+
+std::size_t OtaLatencyHistogram::format(std::span<char> buffer) const
+{
+    if (buffer.empty())
+        return 0;
+
+    char *iter = buffer.data();
+    char * const end = buffer.data() + buffer.size() - 1;
+    const auto append = [&]<typename ...Args>(std::format_string<Args...> fmt, Args &&...args){
+        iter = std::format_to_n(iter, end - iter, fmt, std::forward<Args>(args)...).out;
+        iter = std::min(iter, end);
+    };
+
+    append("n={} mean={}us p50={}us p99={}us max={}us [",
+           m_count, mean().count(), percentile(50).count(), percentile(99).count(), m_max.count());
+    for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+        append("{}{}", i ? "," : "", m_buckets[i]);
+    append("]");
+
+    *iter = '\0';
+    return iter - buffer.data();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// system includes
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Fixed power of two buckets from 16us up to ~0.5s plus one overflow bucket,
+// cheap enough to record every chunk of a job.
+class OtaLatencyHistogram
+{
+public:
+    static constexpr std::size_t BUCKET_COUNT = 16;
+    static constexpr std::chrono::microseconds FIRST_BUCKET{16};
+
+    void reset() { *this = {}; }
+    void record(std::chrono::microseconds latency);
+
+    uint32_t count() const { return m_count; }
+    std::chrono::microseconds max() const { return m_max; }
+    std::chrono::microseconds mean() const { return m_count ? m_sum / m_count : std::chrono::microseconds{}; }
+    // upper bound of the bucket containing the given percentile
+    std::chrono::microseconds percentile(float percent) const;
+    const std::array<uint32_t, BUCKET_COUNT> &buckets() const { return m_buckets; }
+    static std::chrono::microseconds bucketLimit(std::size_t index) { return FIRST_BUCKET * (1 << index); }
+
+    // writes a null terminated summary, truncated to the buffer, returns its length
+    std::size_t format(std::span<char> buffer) const;
+
+private:
+    std::array<uint32_t, BUCKET_COUNT> m_buckets{};
+    uint32_t m_count{};
+    std::chrono::microseconds m_sum{};
+    std::chrono::microseconds m_max{};
+};
@@ -0,0 +1,136 @@
+#include "otamanifest.h"
+
+// system includes
+#include <memory>
+#include <strings.h>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <cJSON.h>
+
+// local includes
+#include "cleanuphelper.h"
+#include "otautils.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr std::size_t MAX_MANIFEST_SIZE = 4096;
+
+std::optional<uint8_t> parseHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return std::nullopt;
+}
+
+std::optional<OtaSha256> parseSha256(std::string_view hex)
+{
+    OtaSha256 digest;
+    if (hex.size() != digest.size() * 2)
+        return std::nullopt;
+
+    for (std::size_t i = 0; i < digest.size(); i++)
+    {
+        const auto high = parseHexDigit(hex[i * 2]);
+        const auto low = parseHexDigit(hex[i * 2 + 1]);
+        if (!high || !low)
+            return std::nullopt;
+        digest[i] = (*high << 4) | *low;
+    }
+
+    return digest;
+}
+
+std::optional<OtaCompression> parseCompression(const char *str)
+{
+    if (!strcasecmp(str, "auto"))
+        return OtaCompression::Auto;
+    if (!strcasecmp(str, "none"))
+        return OtaCompression::None;
+    if (!strcasecmp(str, "gzip"))
+        return OtaCompression::Gzip;
+    if (!strcasecmp(str, "zlib") || !strcasecmp(str, "deflate"))
+        return OtaCompression::Zlib;
+    return std::nullopt;
+}
+} // namespace
+
+std::expected<OtaManifest, std::string> parseOtaManifest(std::string_view json)
+{
+    cJSON * const root = cJSON_ParseWithLength(json.data(), json.size());
+    if (!root)
+        return std::unexpected("invalid json");
+
+    auto helper = cpputils::makeCleanupHelper([&](){ cJSON_Delete(root); });
+
+    if (!cJSON_IsObject(root))
+        return std::unexpected("manifest is not an object");
+
+    OtaManifest manifest;
+
+    if (const auto item = cJSON_GetObjectItemCaseSensitive(root, "version"); cJSON_IsString(item))
+        manifest.version = item->valuestring;
+
+    if (const auto item = cJSON_GetObjectItemCaseSensitive(root, "size"); item)
+    {
+        if (!cJSON_IsNumber(item) || item->valuedouble < 1)
+            return std::unexpected("invalid size");
+        manifest.size = std::size_t(item->valuedouble);
+    }
+
+    if (const auto item = cJSON_GetObjectItemCaseSensitive(root, "sha256"); item)
+    {
+        if (!cJSON_IsString(item) || !(manifest.sha256 = parseSha256(item->valuestring)))
+            return std::unexpected("invalid sha256");
+        manifest.sha256Hex = item->valuestring;
+    }
+
+    if (const auto item = cJSON_GetObjectItemCaseSensitive(root, "compression"); item)
+    {
+        if (!cJSON_IsString(item) || !(manifest.compression = parseCompression(item->valuestring)))
+            return std::unexpected("invalid compression");
+    }
+
+    const auto mirrors = cJSON_GetObjectItemCaseSensitive(root, "mirrors");
+    if (!cJSON_IsArray(mirrors))
+        return std::unexpected("mirrors missing");
+
+    const cJSON *mirror;
+    cJSON_ArrayForEach(mirror, mirrors)
+    {
+        if (!cJSON_IsString(mirror) || !*mirror->valuestring)
+            return std::unexpected("invalid mirror");
+        manifest.mirrors.emplace_back(mirror->valuestring);
+    }
+
+    if (manifest.mirrors.empty())
+        return std::unexpected("no mirrors");
+
+    return manifest;
+}
+
+std::expected<OtaManifest, esp_err_t> fetchOtaManifest(OtaTransport &transport)
+{
+    std::string json;
+    json.resize(MAX_MANIFEST_SIZE);
+
+    const auto size = readOtaFile(transport, {reinterpret_cast<uint8_t *>(json.data()), json.size()}, "manifest");
+    if (!size)
+        return std::unexpected(size.error());
+
+    auto manifest = parseOtaManifest({json.data(), *size});
+    if (!manifest)
+    {
+        ESP_LOGE(TAG, "invalid manifest: %.*s", int(manifest.error().size()), manifest.error().data());
+        return std::unexpected(ESP_ERR_INVALID_RESPONSE);
+    }
+
+    ESP_LOGI(TAG, "manifest version %s with %zd mirrors", manifest->version.c_str(), manifest->mirrors.size());
+
+    return std::move(*manifest);
+}
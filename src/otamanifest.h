@@ -0,0 +1,30 @@
+#pragma once
+
+// system includes
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// local includes
+#include "decompressingotatransport.h"
+#include "otaimagehasher.h"
+#include "otatransport.h"
+
+// Describes an image and where to get it, e.g.
+//   {"version":"1.2.3","size":1234567,"sha256":"<hex>","compression":"gzip",
+//    "mirrors":["https://a.example/fw.bin.gz","https://b.example/fw.bin.gz"]}
+// Only mirrors is required.
+struct OtaManifest
+{
+    std::string version;
+    std::optional<std::size_t> size;
+    std::string sha256Hex;
+    std::optional<OtaSha256> sha256;
+    std::optional<OtaCompression> compression;
+    std::vector<std::string> mirrors;
+};
+
+std::expected<OtaManifest, std::string> parseOtaManifest(std::string_view json);
+std::expected<OtaManifest, esp_err_t> fetchOtaManifest(OtaTransport &transport);
@@ -0,0 +1,46 @@
+#include "otarateestimator.h"
+
+OtaRateEstimator::OtaRateEstimator(std::chrono::microseconds sampleInterval, float alpha) :
+    m_sampleInterval{sampleInterval},
+    m_alpha{alpha}
+{
+}
+
+void OtaRateEstimator::reset(std::size_t bytes, std::chrono::microseconds now)
+{
+    m_lastBytes = bytes;
+    m_lastTs = now;
+    m_hasAverage = false;
+    m_instantRate = 0.f;
+    m_averageRate = 0.f;
+}
+
+void OtaRateEstimator::sample(std::size_t bytes, std::chrono::microseconds now)
+{
+    const auto elapsed = now - m_lastTs;
+    if (elapsed < m_sampleInterval || bytes < m_lastBytes)
+        return;
+
+    m_instantRate = (bytes - m_lastBytes) * 1000000.f / elapsed.count();
+    m_lastBytes = bytes;
+    m_lastTs = now;
+
+    if (m_hasAverage)
+        m_averageRate += m_alpha * (m_instantRate - m_averageRate);
+    else
+    {
+        m_averageRate = m_instantRate;
+        m_hasAverage = true;
+    }
+}
+
+std::optional<std::chrono::milliseconds> OtaRateEstimator::eta(std::size_t bytes, std::optional<std::size_t> totalSize) const
+{
+    if (!totalSize || !m_hasAverage || m_averageRate <= 0.f)
+        return std::nullopt;
+
+    if (bytes >= *totalSize)
+        return std::chrono::milliseconds{0};
+
+    return std::chrono::milliseconds{int64_t((*totalSize - bytes) * 1000.f / m_averageRate)};
+}
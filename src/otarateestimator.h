@@ -0,0 +1,32 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+// Download rate estimation from (bytes, time) samples. The instantaneous rate
+// covers the last sample interval, the average is an exponentially weighted
+// moving average over those intervals.
+class OtaRateEstimator
+{
+public:
+    explicit OtaRateEstimator(std::chrono::microseconds sampleInterval = std::chrono::milliseconds{250}, float alpha = 0.2f);
+
+    void reset(std::size_t bytes, std::chrono::microseconds now);
+    void sample(std::size_t bytes, std::chrono::microseconds now);
+
+    float instantRate() const { return m_instantRate; }
+    float averageRate() const { return m_averageRate; }
+    std::optional<std::chrono::milliseconds> eta(std::size_t bytes, std::optional<std::size_t> totalSize) const;
+
+private:
+    const std::chrono::microseconds m_sampleInterval;
+    const float m_alpha;
+
+    std::size_t m_lastBytes{};
+    std::chrono::microseconds m_lastTs{};
+    bool m_hasAverage{};
+    float m_instantRate{};
+    float m_averageRate{};
+};
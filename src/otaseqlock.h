@@ -0,0 +1,73 @@
+#pragma once
+
+// system includes
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+// esp-idf includes
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Sequence lock for small values shared with the ota task. Writers may come from any
+// task and are serialized by a mutex, readers never block on it and retry
+// until they observe a consistent copy. The payload is stored as relaxed
+// atomic words so concurrent access is well defined. A reader that keeps
+// seeing a store in progress sleeps for a tick, so a preempted writer of lower
+// priority on the same core gets to finish.
+template<typename T>
+class OtaSeqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    OtaSeqlock() { store(T{}); }
+
+    void store(const T &value)
+    {
+        std::array<uint32_t, WORDS> words{};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        std::lock_guard lock{m_writeMutex};
+        const auto seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < WORDS; i++)
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+        std::array<uint32_t, WORDS> words;
+        for (int attempt = 1; ; attempt++)
+        {
+            if (attempt % MAX_SPINS == 0)
+                vTaskDelay(1);
+
+            const auto before = m_seq.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+            for (std::size_t i = 0; i < WORDS; i++)
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_seq.load(std::memory_order_relaxed) == before)
+                break;
+        }
+
+        T value;
+        std::memcpy(&value, words.data(), sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr int MAX_SPINS = 16;
+    static constexpr std::size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::mutex m_writeMutex;
+    std::atomic<uint32_t> m_seq{};
+    std::array<std::atomic<uint32_t>, WORDS> m_words{};
+};
@@ -0,0 +1,161 @@
+#include "otasignatureverifier.h"
+
+// system includes
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <new>
+#include <string>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <mbedtls/pk.h>
+
+// local includes
+#include "cleanuphelper.h"
+#include "otautils.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr std::array<uint8_t, 4> SIGNATURE_MAGIC{'E', 'A', 'S', '1'};
+constexpr std::size_t HEADER_SIZE = 4 + 4 + 4 + 4;
+constexpr std::size_t MAX_FILE_SIZE = 16384;
+} // namespace
+
+OtaSignatureVerifier::OtaSignatureVerifier()
+{
+    mbedtls_sha256_init(&m_context);
+}
+
+OtaSignatureVerifier::~OtaSignatureVerifier()
+{
+    mbedtls_sha256_free(&m_context);
+}
+
+esp_err_t OtaSignatureVerifier::load(OtaTransport &transport, std::string_view publicKeyPem)
+{
+    m_file.reset(new (std::nothrow) uint8_t[MAX_FILE_SIZE]);
+    if (!m_file)
+        return ESP_ERR_NO_MEM;
+
+    const auto read = readOtaFile(transport, {m_file.get(), MAX_FILE_SIZE}, "signature file");
+    if (!read)
+        return read.error();
+    const std::size_t size = *read;
+
+    const uint8_t * const file = m_file.get();
+
+    if (size < HEADER_SIZE || !std::equal(std::begin(SIGNATURE_MAGIC), std::end(SIGNATURE_MAGIC), file))
+    {
+        ESP_LOGE(TAG, "invalid signature file");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    m_chunkSize = readLe32(&file[4]);
+    m_imageSize = readLe32(&file[8]);
+    m_chunkCount = readLe32(&file[12]);
+
+    const auto signatureOffset = HEADER_SIZE + m_chunkCount * 32;
+    if (!m_chunkSize || m_chunkCount != (m_imageSize + m_chunkSize - 1) / m_chunkSize || signatureOffset + 2 > size)
+    {
+        ESP_LOGE(TAG, "inconsistent signature file");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    const std::size_t signatureLength = file[signatureOffset] | (file[signatureOffset + 1] << 8);
+    if (signatureOffset + 2 + signatureLength != size)
+    {
+        ESP_LOGE(TAG, "invalid signature length");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256(file, signatureOffset, digest, 0);
+
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    auto pkHelper = cpputils::makeCleanupHelper([&](){ mbedtls_pk_free(&pk); });
+
+    // PEM parsing requires the terminating null byte to be part of the length
+    const std::string key{publicKeyPem};
+    if (const auto result = mbedtls_pk_parse_public_key(&pk, reinterpret_cast<const unsigned char *>(key.c_str()), key.size() + 1); result != 0)
+    {
+        ESP_LOGE(TAG, "mbedtls_pk_parse_public_key() failed with -0x%04x", -result);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (const auto result = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, sizeof(digest), &file[signatureOffset + 2], signatureLength); result != 0)
+    {
+        ESP_LOGE(TAG, "signature verification failed with -0x%04x", -result);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    ESP_LOGI(TAG, "signature valid, %zd chunks of %zd bytes", m_chunkCount, m_chunkSize);
+
+    m_table = &file[HEADER_SIZE];
+    m_chunkIndex = 0;
+    m_chunkFill = 0;
+    mbedtls_sha256_starts(&m_context, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t OtaSignatureVerifier::update(std::span<const uint8_t> data)
+{
+    if (!m_table)
+        return ESP_ERR_INVALID_STATE;
+
+    while (!data.empty())
+    {
+        if (m_chunkIndex >= m_chunkCount)
+        {
+            ESP_LOGE(TAG, "image larger than signed size %zd", m_imageSize);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        const auto chunkSize = std::min(m_chunkSize, m_imageSize - m_chunkIndex * m_chunkSize);
+        const auto count = std::min(chunkSize - m_chunkFill, data.size());
+        mbedtls_sha256_update(&m_context, data.data(), count);
+        m_chunkFill += count;
+        data = data.subspan(count);
+
+        if (m_chunkFill == chunkSize)
+            if (const auto result = finishChunk(); result != ESP_OK)
+                return result;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t OtaSignatureVerifier::finish()
+{
+    if (!m_table)
+        return ESP_ERR_INVALID_STATE;
+
+    if (m_chunkIndex != m_chunkCount || m_chunkFill)
+    {
+        ESP_LOGE(TAG, "image smaller than signed size %zd", m_imageSize);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t OtaSignatureVerifier::finishChunk()
+{
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&m_context, digest);
+    mbedtls_sha256_starts(&m_context, 0);
+
+    if (std::memcmp(digest, &m_table[m_chunkIndex * 32], sizeof(digest)) != 0)
+    {
+        ESP_LOGE(TAG, "chunk %zd does not match its signed hash", m_chunkIndex);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    m_chunkIndex++;
+    m_chunkFill = 0;
+
+    return ESP_OK;
+}
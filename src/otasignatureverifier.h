@@ -0,0 +1,50 @@
+#pragma once
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+
+// esp-idf includes
+#include <esp_err.h>
+#include <mbedtls/sha256.h>
+
+// local includes
+#include "otatransport.h"
+
+// Verifies an image chunk by chunk against a signed table of chunk hashes, so a
+// tampered or corrupted image is rejected within the first bad chunk instead of
+// after the whole download.
+//
+// Signature file layout (all integers little endian):
+//   "EAS1", u32 chunk size, u32 image size, u32 chunk count,
+//   u8[32] sha256 per chunk,
+//   u16 signature length, u8[length] DER encoded ECDSA signature
+//   over the sha256 of everything before the signature length
+class OtaSignatureVerifier
+{
+public:
+    OtaSignatureVerifier();
+    ~OtaSignatureVerifier();
+
+    esp_err_t load(OtaTransport &transport, std::string_view publicKeyPem);
+    esp_err_t update(std::span<const uint8_t> data);
+    esp_err_t finish();
+
+    std::size_t imageSize() const { return m_imageSize; }
+
+private:
+    esp_err_t finishChunk();
+
+    std::unique_ptr<uint8_t[]> m_file;
+    const uint8_t *m_table{};
+    std::size_t m_chunkSize{};
+    std::size_t m_imageSize{};
+    std::size_t m_chunkCount{};
+
+    mbedtls_sha256_context m_context;
+    std::size_t m_chunkIndex{};
+    std::size_t m_chunkFill{};
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// esp-idf includes
+#include <esp_err.h>
+#include <esp_partition.h>
+
+// Destination of image bytes for EspAsyncOta. finish() verifies and commits the
+// written image, abort() discards it. begin() with a non-zero offset continues
+// a partially written image.
+class OtaSink
+{
+public:
+    virtual ~OtaSink() = default;
+
+    virtual esp_err_t begin(std::optional<std::size_t> imageSize, std::size_t offset) = 0;
+    virtual esp_err_t write(std::span<const uint8_t> data) = 0;
+    virtual esp_err_t finish() = 0;
+    virtual void abort() = 0;
+
+    // sinks writing to a flash partition expose it, which enables persistent resume
+    virtual const esp_partition_t *partition() const { return nullptr; }
+
+    // app images get their header parsed and version checked, and a successful
+    // job restarts the device into them
+    virtual bool bootable() const { return true; }
+};
@@ -0,0 +1,24 @@
+#include "otastaticstorage.h"
+
+TaskHandle_t createOtaStaticTask(TaskFunction_t function, const char *name, OtaStaticTaskStorage storage,
+                                 void *arg, UBaseType_t priority, espcpputils::CoreAffinity coreAffinity)
+{
+    BaseType_t coreId;
+    switch (coreAffinity)
+    {
+    case espcpputils::CoreAffinity::Core0: coreId = 0; break;
+    case espcpputils::CoreAffinity::Core1: coreId = 1; break;
+    default: coreId = tskNO_AFFINITY;
+    }
+
+    return xTaskCreateStaticPinnedToCore(function, name, storage.stack.size(), arg, priority,
+                                         storage.stack.data(), storage.tcb, coreId);
+}
+
+void deleteOtaTask(TaskHandle_t handle)
+{
+    while (eTaskGetState(handle) != eSuspended)
+        vTaskDelay(1);
+
+    vTaskDelete(handle);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// system includes
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// esp-idf includes
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// local includes
+#include "taskutils.h"
+#include "otablockpipeline.h"
+#include "decompressingotatransport.h"
+
+struct OtaStaticTaskStorage
+{
+    std::span<StackType_t> stack;
+    StaticTask_t *tcb;
+};
+
+// Everything EspAsyncOta otherwise takes from the heap for its task and block
+// pipeline, sized at compile time. Stack sizes are in bytes like everywhere in
+// esp-idf. The footprint of a configuration can be checked with
+// static_assert(sizeof(OtaStaticStorage<...>) <= budget).
+template<uint32_t TaskStackSize = 4096, std::size_t BlockCount = 4, std::size_t BlockSize = 4096, uint32_t WriterStackSize = 4096>
+struct OtaStaticStorage
+{
+    static_assert(BlockCount > 0 && BlockSize > 0);
+
+    static constexpr std::size_t blockCount = BlockCount;
+    static constexpr std::size_t blockSize = BlockSize;
+
+    static constexpr std::size_t taskFootprint = sizeof(StaticTask_t) + TaskStackSize * sizeof(StackType_t);
+    static constexpr std::size_t pipelineFootprint = BlockCount * BlockSize + BlockCount * sizeof(OtaBlockPipeline::Block) +
+                                                     (2 * BlockCount + 1) * sizeof(OtaBlockPipeline::Block *) +
+                                                     (BlockCount > 1 ? sizeof(StaticTask_t) + WriterStackSize * sizeof(StackType_t) : 0);
+    // input buffer of the compression detection, the inflate window of compressed images is still allocated
+    static constexpr std::size_t decompressFootprint = DecompressingOtaTransport::inputSize;
+
+    StaticTask_t taskTcb;
+    std::array<StackType_t, TaskStackSize> taskStack;
+    std::array<uint8_t, BlockCount * BlockSize> blockMemory;
+    std::array<OtaBlockPipeline::Block, BlockCount> blocks;
+    std::array<OtaBlockPipeline::Block *, 2 * BlockCount + 1> queueItems;
+    StaticTask_t writerTcb;
+    std::array<StackType_t, (BlockCount > 1 ? WriterStackSize : 0)> writerStack;
+    std::array<uint8_t, DecompressingOtaTransport::inputSize> decompressInput;
+
+    OtaStaticTaskStorage taskStorage()
+    {
+        return { .stack = taskStack, .tcb = &taskTcb };
+    }
+
+    OtaBlockPipeline::Storage pipelineStorage()
+    {
+        return {
+            .memory = blockMemory,
+            .blocks = blocks,
+            .queueItems = queueItems,
+            .writerStack = writerStack,
+            .writerTcb = &writerTcb
+        };
+    }
+};
+
+// The memory may only be reused once the task was removed from every kernel
+// list, so tasks on static storage end with vTaskSuspend(NULL) and get deleted
+// with deleteOtaTask() instead of deleting themselves.
+TaskHandle_t createOtaStaticTask(TaskFunction_t function, const char *name, OtaStaticTaskStorage storage,
+                                 void *arg, UBaseType_t priority, espcpputils::CoreAffinity coreAffinity);
+
+// Waits until the task suspended itself and deletes it. A task deleted while
+// not running is unlinked right away, a self deletion would leave it on the
+// termination list until the idle task of its core runs.
+void deleteOtaTask(TaskHandle_t handle);
@@ -0,0 +1,39 @@
+#include "otatokenbucket.h"
+
+// system includes
+#include <algorithm>
+
+void OtaTokenBucket::configure(const OtaRateLimit &limit, std::chrono::microseconds now)
+{
+    refill(now);
+    // an unlimited bucket counts as full
+    if (!m_limit.bytesPerSecond)
+        m_tokens = limit.burst;
+    m_limit = limit;
+    m_tokens = std::min<int64_t>(m_tokens, m_limit.burst);
+}
+
+std::chrono::microseconds OtaTokenBucket::consume(std::size_t bytes, std::chrono::microseconds now)
+{
+    if (!m_limit.bytesPerSecond)
+        return {};
+
+    refill(now);
+    m_tokens -= bytes;
+
+    if (m_tokens >= 0)
+        return {};
+
+    return std::chrono::microseconds{-m_tokens * 1000000 / int64_t(m_limit.bytesPerSecond)};
+}
+
+void OtaTokenBucket::refill(std::chrono::microseconds now)
+{
+    const auto elapsed = now - m_lastRefill;
+    m_lastRefill = now;
+
+    if (!m_limit.bytesPerSecond || elapsed.count() <= 0)
+        return;
+
+    m_tokens = std::min<int64_t>(m_tokens + elapsed.count() * int64_t(m_limit.bytesPerSecond) / 1000000, m_limit.burst);
+}
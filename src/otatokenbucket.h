@@ -0,0 +1,30 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct OtaRateLimit
+{
+    std::size_t bytesPerSecond{}; // 0 disables the limit
+    std::size_t burst{16384};
+};
+
+// Classic token bucket over bytes. consume() may overdraw the bucket and
+// returns how long the caller has to sleep to pay the debt back.
+class OtaTokenBucket
+{
+public:
+    void configure(const OtaRateLimit &limit, std::chrono::microseconds now);
+    std::chrono::microseconds consume(std::size_t bytes, std::chrono::microseconds now);
+
+    const OtaRateLimit &limit() const { return m_limit; }
+
+private:
+    void refill(std::chrono::microseconds now);
+
+    OtaRateLimit m_limit;
+    int64_t m_tokens{};
+    std::chrono::microseconds m_lastRefill{};
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// system includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// esp-idf includes
+#include <esp_err.h>
+
+// Timing of the last open(), connect covers DNS, TCP and TLS (zero when an
+// existing connection was reused), response the wait for the response headers.
+struct OtaConnectTimings
+{
+    std::chrono::microseconds connect{};
+    std::chrono::microseconds response{};
+};
+
+// Source of image bytes for EspAsyncOta. read() returning 0 means end of stream,
+// ESP_ERR_HTTP_EAGAIN (or any other retryable error) is reported as error.
+class OtaTransport
+{
+public:
+    virtual ~OtaTransport() = default;
+
+    virtual esp_err_t open(std::size_t offset) = 0;
+    virtual std::optional<std::size_t> contentLength() const = 0;
+    virtual std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) = 0;
+    virtual void close() = 0;
+
+    virtual std::string_view contentEncoding() const { return {}; }
+    virtual std::string_view etag() const { return {}; }
+    virtual bool resumable() const { return true; }
+    // of the last response, 0 for transports without one
+    virtual int statusCode() const { return 0; }
+    virtual std::optional<OtaConnectTimings> connectTimings() const { return std::nullopt; }
+};
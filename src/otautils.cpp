@@ -0,0 +1,48 @@
+#include "otautils.h"
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_http_client.h>
+
+// local includes
+#include "cleanuphelper.h"
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr int MAX_READ_RETRIES = 3;
+} // namespace
+
+std::expected<std::size_t, esp_err_t> readOtaFile(OtaTransport &transport, std::span<uint8_t> buffer, const char *what)
+{
+    if (const auto result = transport.open(0); result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "opening %s failed with %s", what, esp_err_to_name(result));
+        return std::unexpected(result);
+    }
+
+    auto helper = cpputils::makeCleanupHelper([&](){ transport.close(); });
+
+    std::size_t size{};
+    for (int retries = 0; ; )
+    {
+        if (size == buffer.size())
+        {
+            ESP_LOGE(TAG, "%s exceeds %zd bytes", what, buffer.size());
+            return std::unexpected(ESP_ERR_INVALID_SIZE);
+        }
+
+        const auto read = transport.read(buffer.subspan(size));
+        if (!read)
+        {
+            if (read.error() == ESP_ERR_HTTP_EAGAIN && ++retries <= MAX_READ_RETRIES)
+                continue;
+            return std::unexpected(read.error());
+        }
+        if (*read == 0)
+            break;
+        size += *read;
+    }
+
+    return size;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// system includes
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+
+// esp-idf includes
+#include <esp_err.h>
+
+// local includes
+#include "otatransport.h"
+
+inline uint32_t readLe32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24);
+}
+
+// Opens the transport and reads a whole small file (manifest, signature) into
+// buffer, retrying a few EAGAINs. Fails with ESP_ERR_INVALID_SIZE when the file
+// does not fit. what names the file in log messages.
+std::expected<std::size_t, esp_err_t> readOtaFile(OtaTransport &transport, std::span<uint8_t> buffer, const char *what);
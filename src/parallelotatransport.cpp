@@ -0,0 +1,312 @@
+#include "parallelotatransport.h"
+
+// system includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+// esp-idf includes
+#include <esp_log.h>
+
+// local includes
+#include "tickchrono.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr int MAX_SEGMENT_RETRIES = 3;
+
+// read() reports EAGAIN after this long so the ota task keeps handling aborts
+constexpr auto READ_WAIT = 100ms;
+} // namespace
+
+ParallelOtaTransport::ParallelOtaTransport(std::span<const std::string> urls, std::size_t connections, std::size_t segmentSize,
+                                           std::string_view cert_pem, bool use_global_ca,
+                                           std::string_view client_key, std::string_view client_cert,
+                                           espcpputils::CoreAffinity coreAffinity, uint32_t stackSize) :
+    m_segmentSize{segmentSize},
+    m_coreAffinity{coreAffinity},
+    m_stackSize{stackSize}
+{
+    assert(!urls.empty());
+    assert(m_segmentSize);
+
+    m_slots.resize(std::max<std::size_t>(connections, 1));
+    for (std::size_t i = 0; i < m_slots.size(); i++)
+    {
+        m_slots[i] = Slot{
+            .parent = this,
+            .index = i,
+            .connection = std::make_unique<HttpOtaTransport>(urls[i % urls.size()], cert_pem, use_global_ca, client_key, client_cert),
+        };
+    }
+}
+
+ParallelOtaTransport::~ParallelOtaTransport()
+{
+    close();
+
+    for (auto &slot : m_slots)
+    {
+        if (slot.filled)
+            vSemaphoreDelete(slot.filled);
+        if (slot.emptied)
+            vSemaphoreDelete(slot.emptied);
+    }
+
+    if (m_workersDone)
+        vSemaphoreDelete(m_workersDone);
+}
+
+esp_err_t ParallelOtaTransport::open(std::size_t offset)
+{
+    close();
+
+    m_base = offset;
+    m_readSegment = 0;
+    m_single = m_slots.size() < 2;
+
+    // the first segment tells whether ranges work and how large the image is
+    auto &first = *m_slots.front().connection;
+    auto result = m_single ? first.open(offset) : first.openRange(offset, m_segmentSize);
+    if (!m_single && result == ESP_OK && !first.contentLength())
+    {
+        ESP_LOGW(TAG, "no Content-Range in response, falling back to a single stream");
+        result = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (!m_single && result == ESP_ERR_INVALID_RESPONSE)
+    {
+        m_single = true;
+        result = first.open(offset);
+    }
+
+    if (result != ESP_OK)
+        return result;
+
+    m_totalSize = first.contentLength();
+    m_contentEncoding = first.contentEncoding();
+    m_etag = first.etag();
+
+    if (m_single)
+        return ESP_OK;
+
+    m_segmentCount = (*m_totalSize - std::min(offset, *m_totalSize) + m_segmentSize - 1) / m_segmentSize;
+    m_slots.front().preopened = true;
+
+    if (const auto result = startWorkers(); result != ESP_OK)
+    {
+        close();
+        return result;
+    }
+
+    ESP_LOGI(TAG, "fetching %zd segments over %zd connections", m_segmentCount, m_workerCount);
+
+    return ESP_OK;
+}
+
+std::expected<std::size_t, esp_err_t> ParallelOtaTransport::read(std::span<uint8_t> buffer)
+{
+    if (!m_totalSize && !m_single)
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+
+    if (m_single)
+        return m_slots.front().connection->read(buffer);
+
+    if (m_readSegment >= m_segmentCount)
+        return 0;
+
+    if (!m_workerCount)
+        return std::unexpected(ESP_ERR_INVALID_STATE);
+
+    auto &slot = m_slots[m_readSegment % m_slots.size()];
+    if (!slot.ready)
+    {
+        if (xSemaphoreTake(slot.filled, std::chrono::ceil<espcpputils::ticks>(READ_WAIT).count()) != pdTRUE)
+            return std::unexpected(ESP_ERR_HTTP_EAGAIN);
+
+        if (slot.error != ESP_OK)
+            return std::unexpected(slot.error);
+
+        slot.ready = true;
+        slot.readPos = 0;
+    }
+
+    const auto count = std::min(buffer.size(), slot.size - slot.readPos);
+    std::memcpy(buffer.data(), slot.data + slot.readPos, count);
+    slot.readPos += count;
+
+    if (slot.readPos == slot.size)
+    {
+        slot.ready = false;
+        m_readSegment++;
+        xSemaphoreGive(slot.emptied);
+    }
+
+    return count;
+}
+
+void ParallelOtaTransport::close()
+{
+    stopWorkers();
+
+    for (auto &slot : m_slots)
+    {
+        slot.connection->close();
+        slot.preopened = false;
+        slot.ready = false;
+    }
+
+    m_totalSize = std::nullopt;
+    m_single = false;
+}
+
+/*static*/ void ParallelOtaTransport::workerTask(void *arg)
+{
+    auto slot = reinterpret_cast<Slot*>(arg);
+
+    assert(slot);
+
+    slot->parent->workerTask(*slot);
+}
+
+void ParallelOtaTransport::workerTask(Slot &slot)
+{
+    for (std::size_t segment = slot.index; segment < m_segmentCount; segment += m_slots.size())
+    {
+        xSemaphoreTake(slot.emptied, portMAX_DELAY);
+        if (m_stopping.load())
+            break;
+
+        slot.error = fetch(slot, segment);
+        xSemaphoreGive(slot.filled);
+
+        if (slot.error != ESP_OK)
+            break;
+    }
+
+    xSemaphoreGive(m_workersDone);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ParallelOtaTransport::fetch(Slot &slot, std::size_t segment)
+{
+    const auto start = m_base + segment * m_segmentSize;
+    const auto length = std::min(m_segmentSize, *m_totalSize - start);
+
+    slot.size = 0;
+
+    for (int retries = 0; ; )
+    {
+        if (!slot.preopened)
+        {
+            if (const auto result = slot.connection->openRange(start + slot.size, length - slot.size); result != ESP_OK)
+            {
+                if (++retries > MAX_SEGMENT_RETRIES || m_stopping.load())
+                    return result;
+                continue;
+            }
+
+            if (slot.connection->contentLength() != m_totalSize)
+            {
+                ESP_LOGE(TAG, "image size changed on connection %zd", slot.index);
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+        }
+        slot.preopened = false;
+
+        while (slot.size < length)
+        {
+            if (m_stopping.load())
+                return ESP_ERR_INVALID_STATE;
+
+            const auto read = slot.connection->read({slot.data + slot.size, length - slot.size});
+            if (!read)
+            {
+                if (read.error() == ESP_ERR_HTTP_EAGAIN)
+                    continue;
+                break;
+            }
+            if (*read == 0)
+                break;
+            slot.size += *read;
+        }
+
+        if (slot.size == length)
+            return ESP_OK;
+
+        ESP_LOGW(TAG, "segment %zd interrupted at %zd of %zd bytes", segment, slot.size, length);
+        slot.connection->close();
+        if (++retries > MAX_SEGMENT_RETRIES)
+            return ESP_ERR_HTTP_INCOMPLETE_DATA;
+    }
+}
+
+esp_err_t ParallelOtaTransport::startWorkers()
+{
+    if (!m_memory)
+    {
+        m_memory.reset(new (std::nothrow) uint8_t[m_slots.size() * m_segmentSize]);
+        if (!m_memory)
+        {
+            ESP_LOGE(TAG, "could not allocate %zd segments of %zd bytes", m_slots.size(), m_segmentSize);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (!m_workersDone)
+        m_workersDone = xSemaphoreCreateCounting(m_slots.size(), 0);
+    if (!m_workersDone)
+        return ESP_ERR_NO_MEM;
+
+    m_stopping.store(false);
+
+    for (auto &slot : m_slots)
+    {
+        slot.data = &m_memory[slot.index * m_segmentSize];
+
+        if (!slot.filled)
+            slot.filled = xSemaphoreCreateBinary();
+        if (!slot.emptied)
+            slot.emptied = xSemaphoreCreateBinary();
+        if (!slot.filled || !slot.emptied)
+            return ESP_ERR_NO_MEM;
+
+        xSemaphoreTake(slot.filled, 0);
+        xSemaphoreGive(slot.emptied);
+
+        if (slot.index >= m_segmentCount)
+            continue;
+
+        slot.task = {};
+        const auto result = espcpputils::createTask(workerTask, "asyncOtaFetch", m_stackSize, &slot,
+                                                    uxTaskPriorityGet(NULL), &slot.task, m_coreAffinity);
+        if (result != pdPASS || !slot.task)
+        {
+            ESP_LOGE(TAG, "failed creating ota fetch task %i", result);
+            return ESP_ERR_NO_MEM;
+        }
+        m_workerCount++;
+    }
+
+    return ESP_OK;
+}
+
+void ParallelOtaTransport::stopWorkers()
+{
+    if (!m_workerCount)
+        return;
+
+    m_stopping.store(true);
+
+    for (auto &slot : m_slots)
+        if (slot.emptied)
+            xSemaphoreGive(slot.emptied);
+
+    // workers notice the stop between reads, at worst after the http timeout
+    for (; m_workerCount; m_workerCount--)
+        xSemaphoreTake(m_workersDone, portMAX_DELAY);
+}
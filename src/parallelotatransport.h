@@ -0,0 +1,86 @@
+#pragma once
+
+// system includes
+#include <atomic>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// esp-idf includes
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// local includes
+#include "taskutils.h"
+#include "httpotatransport.h"
+
+// Fetches the image as fixed size segments over several connections at once
+// (one worker task each) and hands them out in order. Connection i fetches
+// segments i, i + n, i + 2n, ..., so memory use is connections * segmentSize.
+// Servers without range support are read as a single stream over the first
+// connection.
+class ParallelOtaTransport : public OtaTransport
+{
+public:
+    ParallelOtaTransport(std::span<const std::string> urls, std::size_t connections, std::size_t segmentSize,
+                         std::string_view cert_pem, bool use_global_ca,
+                         std::string_view client_key, std::string_view client_cert,
+                         espcpputils::CoreAffinity coreAffinity, uint32_t stackSize=4096);
+    ~ParallelOtaTransport() override;
+
+    esp_err_t open(std::size_t offset) override;
+    std::optional<std::size_t> contentLength() const override { return m_totalSize; }
+    std::expected<std::size_t, esp_err_t> read(std::span<uint8_t> buffer) override;
+    void close() override;
+    std::string_view contentEncoding() const override { return m_contentEncoding; }
+    std::string_view etag() const override { return m_etag; }
+    int statusCode() const override { return m_slots.front().connection->statusCode(); }
+    std::optional<OtaConnectTimings> connectTimings() const override { return m_slots.front().connection->connectTimings(); }
+
+private:
+    struct Slot
+    {
+        ParallelOtaTransport *parent;
+        std::size_t index;
+        std::unique_ptr<HttpOtaTransport> connection;
+        uint8_t *data;
+
+        // written by the worker before giving filled
+        std::size_t size;
+        esp_err_t error;
+
+        // owned by the reader
+        std::size_t readPos;
+        bool ready;
+
+        bool preopened;
+        SemaphoreHandle_t filled;
+        SemaphoreHandle_t emptied;
+        TaskHandle_t task;
+    };
+
+    static void workerTask(void *arg);
+    void workerTask(Slot &slot);
+    esp_err_t fetch(Slot &slot, std::size_t segment);
+    esp_err_t startWorkers();
+    void stopWorkers();
+
+    const std::size_t m_segmentSize;
+    const espcpputils::CoreAffinity m_coreAffinity;
+    const uint32_t m_stackSize;
+
+    std::vector<Slot> m_slots;
+    std::unique_ptr<uint8_t[]> m_memory;
+    SemaphoreHandle_t m_workersDone{};
+    std::size_t m_workerCount{};
+    std::atomic<bool> m_stopping{};
+
+    bool m_single{};
+    std::size_t m_base{};
+    std::optional<std::size_t> m_totalSize;
+    std::size_t m_segmentCount{};
+    std::size_t m_readSegment{};
+    std::string m_contentEncoding;
+    std::string m_etag;
+};
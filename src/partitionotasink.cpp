@@ -0,0 +1,166 @@
+#include "partitionotasink.h"
+
+// system includes
+#include <algorithm>
+#include <string>
+
+// esp-idf includes
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+
+namespace {
+constexpr const char * const TAG = "ASYNC_OTA";
+
+constexpr std::size_t SECTOR_SIZE = 4096;
+} // namespace
+
+PartitionOtaSink::PartitionOtaSink(const esp_partition_t *partition) :
+    m_partition{partition}
+{
+}
+
+PartitionOtaSink::~PartitionOtaSink()
+{
+    abort();
+}
+
+const esp_partition_t *PartitionOtaSink::find(std::string_view label)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_ANY, ESP_PARTITION_SUBTYPE_ANY, std::string{label}.c_str());
+}
+
+const esp_partition_t *PartitionOtaSink::find(esp_partition_subtype_t dataSubtype)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, dataSubtype, nullptr);
+}
+
+esp_err_t PartitionOtaSink::begin(std::optional<std::size_t> imageSize, std::size_t offset)
+{
+    abort();
+
+    if (!m_partition)
+    {
+        ESP_LOGE(TAG, "no target partition available");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (m_partition == esp_ota_get_running_partition())
+    {
+        ESP_LOGE(TAG, "cannot write to the running partition %s", m_partition->label);
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+
+    if (imageSize && *imageSize > m_partition->size)
+    {
+        ESP_LOGE(TAG, "image size %zd exceeds partition size %lu", *imageSize, m_partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (offset % SECTOR_SIZE)
+    {
+        ESP_LOGE(TAG, "resume offset %zd is not sector aligned", offset);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_LOGI(TAG, "writing to partition %s at 0x%lx (offset %zd)", m_partition->label, m_partition->address, offset);
+
+    m_active = true;
+    m_offset = offset;
+    m_erasedUntil = offset;
+    m_partialSize = 0;
+
+    return ESP_OK;
+}
+
+esp_err_t PartitionOtaSink::write(std::span<const uint8_t> data)
+{
+    if (!m_active)
+        return ESP_ERR_INVALID_STATE;
+
+    if (data.empty())
+        return ESP_OK;
+
+    if (!m_partition->encrypted)
+        return writeAligned(data);
+
+    if (m_partialSize)
+    {
+        const auto count = std::min(m_partial.size() - m_partialSize, data.size());
+        std::copy_n(std::begin(data), count, std::begin(m_partial) + m_partialSize);
+        m_partialSize += count;
+        data = data.subspan(count);
+
+        if (m_partialSize < m_partial.size())
+            return ESP_OK;
+
+        m_partialSize = 0;
+        if (const auto result = writeAligned(m_partial); result != ESP_OK)
+            return result;
+    }
+
+    const auto aligned = data.size() - data.size() % m_partial.size();
+    if (const auto result = writeAligned(data.first(aligned)); result != ESP_OK)
+        return result;
+
+    m_partialSize = data.size() - aligned;
+    std::copy(std::begin(data) + aligned, std::end(data), std::begin(m_partial));
+
+    return ESP_OK;
+}
+
+esp_err_t PartitionOtaSink::finish()
+{
+    if (!m_active)
+        return ESP_ERR_INVALID_STATE;
+
+    if (m_partialSize)
+    {
+        std::fill(std::begin(m_partial) + m_partialSize, std::end(m_partial), 0xFF);
+        m_partialSize = 0;
+        if (const auto result = writeAligned(m_partial); result != ESP_OK)
+            return result;
+    }
+
+    m_active = false;
+
+    return ESP_OK;
+}
+
+void PartitionOtaSink::abort()
+{
+    m_active = false;
+    m_partialSize = 0;
+}
+
+esp_err_t PartitionOtaSink::writeAligned(std::span<const uint8_t> data)
+{
+    if (data.empty())
+        return ESP_OK;
+
+    if (m_offset + data.size() > m_partition->size)
+    {
+        ESP_LOGE(TAG, "image exceeds partition size %lu", m_partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (m_offset + data.size() > m_erasedUntil)
+    {
+        const auto end = std::min<std::size_t>((m_offset + data.size() + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE, m_partition->size);
+        if (const auto result = esp_partition_erase_range(m_partition, m_erasedUntil, end - m_erasedUntil); result != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_partition_erase_range() failed with %s", esp_err_to_name(result));
+            return result;
+        }
+        m_erasedUntil = end;
+    }
+
+    if (const auto result = esp_partition_write(m_partition, m_offset, data.data(), data.size()); result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_partition_write() failed with %s", esp_err_to_name(result));
+        return result;
+    }
+
+    m_offset += data.size();
+
+    return ESP_OK;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// system includes
+#include <array>
+#include <string_view>
+
+// esp-idf includes
+#include <esp_partition.h>
+
+// local includes
+#include "otasink.h"
+
+// Writes raw bytes into any flash partition (filesystem images, model blobs,
+// config data), erasing sector by sector ahead of the write position. Nothing
+// is parsed and finish() only flushes, so the device keeps running afterwards.
+class PartitionOtaSink : public OtaSink
+{
+public:
+    explicit PartitionOtaSink(const esp_partition_t *partition);
+    ~PartitionOtaSink() override;
+
+    static const esp_partition_t *find(std::string_view label);
+    static const esp_partition_t *find(esp_partition_subtype_t dataSubtype);
+
+    esp_err_t begin(std::optional<std::size_t> imageSize, std::size_t offset) override;
+    esp_err_t write(std::span<const uint8_t> data) override;
+    esp_err_t finish() override;
+    void abort() override;
+
+    const esp_partition_t *partition() const override { return m_partition; }
+    bool bootable() const override { return false; }
+
+protected:
+    std::size_t position() const { return m_offset + m_partialSize; }
+
+private:
+    esp_err_t writeAligned(std::span<const uint8_t> data);
+
+    const esp_partition_t * const m_partition;
+    bool m_active{};
+    std::size_t m_offset{};
+    std::size_t m_erasedUntil{};
+
+    // encrypted partitions only accept 16 byte aligned writes
+    std::array<uint8_t, 16> m_partial;
+    std::size_t m_partialSize{};
+};